@@ -0,0 +1,666 @@
+/*
+ * Throughput benchmark for nanojson
+ *
+ *   g++ -std=c++11 -O2 -pthread -I. -o bench bench.cpp
+ *   ./bench [-s megabytes] [-n runs] [-t threads] [dataset ...]
+ *
+ * datasets: wide deep numeric strings sparse ndjson (all of them by default)
+ *
+ * Every dataset is generated in memory with a fixed seed, so the numbers are
+ * comparable between builds. Each engine runs in its own forked process:
+ * the best of the timed runs is reported, allocations are counted over one
+ * more run through the global operator new, and the peak RSS is that of the
+ * child process (input buffer included).
+ * A "doc" is one record: an element of the root array, or one NDJSON line.
+ */
+
+#include "nanojson.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* allocation counting; picojson::arena blocks come from malloc and are not included */
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+static std::atomic<size_t> alloc_count(0);
+static std::atomic<size_t> alloc_bytes(0);
+
+void *operator new(size_t n)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+    void *p = std::malloc(n ? n : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+BENCH_NOINLINE void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+struct Wide : public nanojson::object<Wide>
+{
+    def(int64_t, id);
+    def(std::string, name);
+    def(std::string, email);
+    def(bool, active);
+    def(int, age);
+    def(double, score);
+    def(double, balance);
+    def(std::string, country);
+    def(std::string, city);
+    def(int, zip);
+    def(double, lat);
+    def(double, lon);
+    def(int64_t, created);
+    def(int64_t, updated);
+    def(unsigned int, flags);
+    def(float, rating);
+    def(int, visits);
+    def(std::string, ref);
+    def(std::string, note);
+    def(short, level);
+};
+
+struct WideDoc : public nanojson::object<WideDoc>
+{
+    def(std::vector<Wide>, rows);
+};
+
+/* reads two of the twenty fields of Wide */
+struct Narrow : public nanojson::object<Narrow>
+{
+    def(int64_t, id);
+    def(std::string, name);
+};
+
+struct NarrowDoc : public nanojson::object<NarrowDoc>
+{
+    def(std::vector<Narrow>, rows);
+};
+
+struct Node : public nanojson::object<Node>
+{
+    def(int, id);
+    def(std::string, kind);
+    def(std::vector<Node>, children);
+};
+
+struct DeepDoc : public nanojson::object<DeepDoc>
+{
+    def(std::vector<Node>, nodes);
+};
+
+struct NumericDoc : public nanojson::object<NumericDoc>
+{
+    def(std::vector<int64_t>, ids);
+    def(std::vector<std::vector<double> >, values);
+};
+
+struct Text : public nanojson::object<Text>
+{
+    def(std::string, id);
+    def(std::string, title);
+    def(std::string, body);
+    def(std::vector<std::string>, tags);
+};
+
+struct StringDoc : public nanojson::object<StringDoc>
+{
+    def(std::vector<Text>, items);
+};
+
+/* deterministic generator (xorshift64) */
+class random_source
+{
+    uint64_t s;
+public:
+    random_source() : s(88172645463325252ULL) { }
+    uint64_t next()
+    {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+    int below(int n) { return (int)(next() % (uint64_t)n); }
+    double real() { return (double)(next() >> 11) / 9007199254740992.0; }
+};
+
+static void append_int(std::string &out, long long v)
+{
+    char buf[32];
+    out.append(buf, std::snprintf(buf, sizeof(buf), "%lld", v));
+}
+
+static void append_real(std::string &out, double v)
+{
+    char buf[32];
+    out.append(buf, std::snprintf(buf, sizeof(buf), "%.17g", v));
+}
+
+static void append_word(std::string &out, random_source &rnd, int len)
+{
+    for(int i = 0; i < len; ++i)
+        out.push_back('a' + rnd.below(26));
+}
+
+static void append_text(std::string &out, random_source &rnd, int words)
+{
+    static const char *const escapes[] = { "\\n", "\\\"", "\\\\", "\\t", "\\u00e9", "\\u3042" };
+    out.push_back('"');
+    for(int i = 0; i < words; ++i)
+    {
+        if(i)
+            out.push_back(' ');
+        if(rnd.below(16) == 0)
+            out += escapes[rnd.below(6)];
+        else
+            append_word(out, rnd, 2 + rnd.below(9));
+    }
+    out.push_back('"');
+}
+
+static void append_wide(std::string &out, random_source &rnd, long long id)
+{
+    out += "{\"id\":"; append_int(out, id);
+    out += ",\"name\":\""; append_word(out, rnd, 6 + rnd.below(10));
+    out += "\",\"email\":\""; append_word(out, rnd, 8); out += "@example.com";
+    out += rnd.below(2) ? "\",\"active\":true" : "\",\"active\":false";
+    out += ",\"age\":"; append_int(out, 18 + rnd.below(60));
+    out += ",\"score\":"; append_real(out, rnd.real() * 100);
+    out += ",\"balance\":"; append_real(out, rnd.real() * 1e6 - 5e5);
+    out += ",\"country\":\""; append_word(out, rnd, 2);
+    out += "\",\"city\":\""; append_word(out, rnd, 5 + rnd.below(8));
+    out += "\",\"zip\":"; append_int(out, 10000 + rnd.below(90000));
+    out += ",\"lat\":"; append_real(out, rnd.real() * 180 - 90);
+    out += ",\"lon\":"; append_real(out, rnd.real() * 360 - 180);
+    out += ",\"created\":"; append_int(out, 1500000000000LL + (long long)(rnd.next() % 100000000000ULL));
+    out += ",\"updated\":"; append_int(out, 1600000000000LL + (long long)(rnd.next() % 100000000000ULL));
+    out += ",\"flags\":"; append_int(out, rnd.below(65536));
+    out += ",\"rating\":"; append_real(out, (float)(rnd.real() * 5));
+    out += ",\"visits\":"; append_int(out, rnd.below(100000));
+    out += ",\"ref\":\""; append_word(out, rnd, 12);
+    out += "\",\"note\":"; append_text(out, rnd, 4 + rnd.below(12));
+    out += ",\"level\":"; append_int(out, rnd.below(100));
+    out += "}";
+}
+
+static void append_node(std::string &out, random_source &rnd, int depth, int &id)
+{
+    out += "{\"id\":"; append_int(out, id++);
+    out += ",\"kind\":\""; append_word(out, rnd, 4);
+    out += "\",\"children\":[";
+    if(depth > 0)
+    {
+        int n = rnd.below(4) == 0 ? 2 : 1;
+        for(int i = 0; i < n; ++i)
+        {
+            if(i)
+                out.push_back(',');
+            append_node(out, rnd, depth - (i ? 8 : 1), id);
+        }
+    }
+    out += "]}";
+}
+
+/* the generators return the number of records written */
+static size_t generate_wide(std::string &out, size_t size)
+{
+    random_source rnd;
+    size_t n = 0;
+    out = "{\"rows\":[";
+    while(out.size() < size)
+    {
+        if(n)
+            out.push_back(',');
+        append_wide(out, rnd, (long long)n++);
+    }
+    out += "]}";
+    return n;
+}
+
+static size_t generate_deep(std::string &out, size_t size)
+{
+    random_source rnd;
+    size_t n = 0;
+    int id = 0;
+    out = "{\"nodes\":[";
+    while(out.size() < size)
+    {
+        if(n++)
+            out.push_back(',');
+        append_node(out, rnd, 48, id);
+    }
+    out += "]}";
+    return n;
+}
+
+static size_t generate_numeric(std::string &out, size_t size)
+{
+    random_source rnd;
+    size_t n = 0;
+    out = "{\"ids\":[";
+    while(out.size() < size / 4)
+    {
+        if(n++)
+            out.push_back(',');
+        append_int(out, (long long)(rnd.next() >> 1) - (1LL << 62));
+    }
+    out += "],\"values\":[";
+    for(size_t rows = 0; out.size() < size; ++rows, ++n)
+    {
+        if(rows)
+            out.push_back(',');
+        out.push_back('[');
+        for(int i = 0; i < 8; ++i)
+        {
+            if(i)
+                out.push_back(',');
+            append_real(out, (rnd.real() - 0.5) * std::pow(10.0, rnd.below(12) - 4));
+        }
+        out.push_back(']');
+    }
+    out += "]}";
+    return n;
+}
+
+static size_t generate_strings(std::string &out, size_t size)
+{
+    random_source rnd;
+    size_t n = 0;
+    out = "{\"items\":[";
+    while(out.size() < size)
+    {
+        if(n++)
+            out.push_back(',');
+        out += "{\"id\":\""; append_word(out, rnd, 16);
+        out += "\",\"title\":"; append_text(out, rnd, 3 + rnd.below(8));
+        out += ",\"body\":"; append_text(out, rnd, 20 + rnd.below(200));
+        out += ",\"tags\":[";
+        for(int i = 0, k = rnd.below(6); i < k; ++i)
+        {
+            if(i)
+                out.push_back(',');
+            out.push_back('"');
+            append_word(out, rnd, 3 + rnd.below(6));
+            out.push_back('"');
+        }
+        out += "]}";
+    }
+    out += "]}";
+    return n;
+}
+
+static size_t generate_ndjson(std::string &out, size_t size)
+{
+    random_source rnd;
+    size_t n = 0;
+    out.clear();
+    while(out.size() < size)
+    {
+        append_wide(out, rnd, (long long)n++);
+        out.push_back('\n');
+    }
+    return n;
+}
+
+/* lets ndjson_reader read straight from the generated buffer */
+class memory_buffer : public std::streambuf
+{
+public:
+    memory_buffer(const std::string &s)
+    {
+        char *p = const_cast<char *>(s.data());
+        setg(p, p, p + s.size());
+    }
+};
+
+struct options
+{
+    size_t size;
+    int runs;
+    unsigned int threads;
+};
+
+struct result
+{
+    bool ok;
+    double seconds;
+    size_t allocs;
+    size_t alloc_bytes;
+    long peak_rss_kb;
+};
+
+static long peak_rss_kb()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+static result measure(const options &opt, const std::function<bool()> &f)
+{
+    result r = result();
+    try
+    {
+        r.ok = f();
+        r.seconds = 1e30;
+        for(int i = 0; r.ok && i < opt.runs; ++i)
+        {
+            std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+            r.ok = f();
+            double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+            if(s < r.seconds)
+                r.seconds = s;
+        }
+        size_t count = alloc_count.load(), bytes = alloc_bytes.load();
+        r.ok = r.ok && f();
+        r.allocs = alloc_count.load() - count;
+        r.alloc_bytes = alloc_bytes.load() - bytes;
+    }
+    catch(const std::exception &e)
+    {
+        std::fprintf(stderr, "  %s\n", e.what());
+        r.ok = false;
+    }
+    r.peak_rss_kb = peak_rss_kb();
+    return r;
+}
+
+/* runs f in a child process so the peak RSS of one engine does not leak into the next */
+static void run(const options &opt, const char *engine, size_t bytes, size_t docs, const std::function<bool()> &f)
+{
+    int fds[2];
+    result r = result();
+    pid_t pid;
+    std::fflush(stdout);
+    if(pipe(fds) == 0 && (pid = fork()) >= 0)
+    {
+        if(pid == 0)
+        {
+            close(fds[0]);
+            r = measure(opt, f);
+            ssize_t written = write(fds[1], &r, sizeof(r));
+            _exit(written == (ssize_t)sizeof(r) ? 0 : 1);
+        }
+        close(fds[1]);
+        if(read(fds[0], &r, sizeof(r)) != (ssize_t)sizeof(r))
+            r.ok = false;
+        close(fds[0]);
+        waitpid(pid, 0, 0);
+    }
+    else
+        r = measure(opt, f);
+
+    if(!r.ok)
+    {
+        std::printf("  %-28s %10s\n", engine, "failed");
+        return;
+    }
+    std::printf("  %-28s %10.1f %12.0f %10.1f %12.1f %10.1f\n",
+        engine,
+        bytes / r.seconds / (1024 * 1024),
+        docs / r.seconds,
+        (double)r.allocs / docs,
+        (double)r.alloc_bytes / docs,
+        r.peak_rss_kb / 1024.0);
+}
+
+static void header(const char *dataset, const std::string &json, size_t docs)
+{
+    std::printf("\n%s: %.1f MB, %lu docs\n", dataset, json.size() / (1024.0 * 1024.0), (unsigned long)docs);
+    std::printf("  %-28s %10s %12s %10s %12s %10s\n", "engine", "MB/s", "docs/s", "allocs/doc", "bytes/doc", "peak MB");
+}
+
+template<typename T>
+static void bench_document(const options &opt, const char *dataset, size_t (*generate)(std::string &, size_t))
+{
+    std::string json;
+    size_t docs = generate(json, opt.size);
+    const char *begin = json.data(), *end = begin + json.size();
+    header(dataset, json, docs);
+
+    run(opt, "reader::parse<T>", json.size(), docs, [&]()
+    {
+        nanojson::reader reader;
+        T v = reader.parse<T>(begin, json.size());
+        return true;
+    });
+    T reused;
+    run(opt, "reader::parse_into", json.size(), docs, [&]()
+    {
+        nanojson::reader reader;
+        reader.parse_into(reused, begin, json.size());
+        return true;
+    });
+    run(opt, "reader (indexed)", json.size(), docs, [&]()
+    {
+        nanojson::reader reader;
+        reader.set_indexed(true);
+        T v = reader.parse<T>(begin, json.size());
+        return true;
+    });
+    if(opt.threads != 1)
+    {
+        run(opt, "reader (threads)", json.size(), docs, [&]()
+        {
+            nanojson::reader reader;
+            reader.set_threads(opt.threads);
+            T v = reader.parse<T>(begin, json.size());
+            return true;
+        });
+    }
+    run(opt, "push_parser (64KB pieces)", json.size(), docs, [&]()
+    {
+        T v;
+        nanojson::push_parser<T> parser(v);
+        for(size_t i = 0; i < json.size(); i += 65536)
+        {
+            if(!parser.feed(begin + i, std::min<size_t>(65536, json.size() - i)))
+                return false;
+        }
+        return parser.finish();
+    });
+    run(opt, "picojson::parse", json.size(), docs, [&]()
+    {
+        picojson::value v;
+        std::string err;
+        picojson::parse(v, begin, end, &err);
+        return err.empty();
+    });
+    picojson::arena a;
+    run(opt, "picojson::parse (arena)", json.size(), docs, [&]()
+    {
+        a.clear();  // rewinds, so only the first iteration allocates blocks
+        picojson::value v;
+        std::string err;
+        picojson::parse(v, begin, end, &err, &a);
+        return err.empty();
+    });
+
+    nanojson::reader reader;
+    T v = reader.parse<T>(begin, json.size());
+    nanojson::writer w;
+    w.write(v);
+    run(opt, "writer", w.size(), docs, [&]()
+    {
+        nanojson::writer w;
+        w.write(v);
+        return w.size() != 0;
+    });
+}
+
+/* the wide dataset when only a few members are needed */
+static void bench_sparse(const options &opt)
+{
+    std::string json;
+    size_t docs = generate_wide(json, opt.size);
+    const char *begin = json.data();
+    header("sparse", json, docs);
+
+    run(opt, "reader::parse<T>", json.size(), docs, [&]()
+    {
+        nanojson::reader reader;
+        NarrowDoc v = reader.parse<NarrowDoc>(begin, json.size());
+        return true;
+    });
+    run(opt, "reader (indexed)", json.size(), docs, [&]()
+    {
+        nanojson::reader reader;
+        reader.set_indexed(true);
+        NarrowDoc v = reader.parse<NarrowDoc>(begin, json.size());
+        return true;
+    });
+
+    nanojson::projection proj;
+    proj.ignore(&Wide::email).ignore(&Wide::active).ignore(&Wide::age).ignore(&Wide::score)
+        .ignore(&Wide::balance).ignore(&Wide::country).ignore(&Wide::city).ignore(&Wide::zip)
+        .ignore(&Wide::lat).ignore(&Wide::lon).ignore(&Wide::created).ignore(&Wide::updated)
+        .ignore(&Wide::flags).ignore(&Wide::rating).ignore(&Wide::visits).ignore(&Wide::ref)
+        .ignore(&Wide::note).ignore(&Wide::level);
+    run(opt, "reader (projection)", json.size(), docs, [&]()
+    {
+        nanojson::reader reader;
+        reader.set_projection(&proj);
+        WideDoc v = reader.parse<WideDoc>(begin, json.size());
+        return true;
+    });
+}
+
+static void bench_ndjson(const options &opt)
+{
+    std::string json;
+    size_t docs = generate_ndjson(json, opt.size);
+    header("ndjson", json, docs);
+
+    run(opt, "ndjson_reader::next", json.size(), docs, [&]()
+    {
+        memory_buffer buf(json);
+        std::istream is(&buf);
+        nanojson::ndjson_reader<Wide> reader(is);
+        Wide w;
+        size_t n = 0;
+        nanojson::ndjson_reader<Wide>::status st;
+        while((st = reader.next(w)) == nanojson::ndjson_reader<Wide>::record)
+            ++n;
+        return st == nanojson::ndjson_reader<Wide>::end_of_stream && n == docs;
+    });
+    run(opt, "ndjson_reader::parse_all", json.size(), docs, [&]()
+    {
+        std::vector<Wide> out;
+        return nanojson::ndjson_reader<Wide>::parse_all(json.data(), json.size(), out, opt.threads).empty()
+            && out.size() == docs;
+    });
+    run(opt, "picojson::parse", json.size(), docs, [&]()
+    {
+        const char *p = json.data(), *end = p + json.size();
+        while(p != end)
+        {
+            const char *eol = (const char *)std::memchr(p, '\n', end - p);
+            picojson::value v;
+            std::string err;
+            picojson::parse(v, p, eol, &err);
+            if(!err.empty())
+                return false;
+            p = eol + 1;
+        }
+        return true;
+    });
+
+    std::vector<Wide> records;
+    nanojson::ndjson_reader<Wide>::parse_all(json.data(), json.size(), records, 1);
+    nanojson::writer probe;
+    for(size_t i = 0; i < records.size(); ++i)
+        probe.write(records[i]);
+    run(opt, "writer", probe.size() + records.size(), docs, [&]()
+    {
+        nanojson::writer w;
+        for(size_t i = 0; i < records.size(); ++i)
+        {
+            w.write(records[i]);
+            w.clear();
+        }
+        return true;
+    });
+}
+
+int main(int argc, const char *argv[])
+{
+    options opt;
+    opt.size = 16 << 20;
+    opt.runs = 5;
+    opt.threads = 0;
+    std::vector<std::string> datasets;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "-s") && i + 1 < argc)
+            opt.size = (size_t)(std::atof(argv[++i]) * (1 << 20));
+        else if(!std::strcmp(argv[i], "-n") && i + 1 < argc)
+            opt.runs = std::atoi(argv[++i]);
+        else if(!std::strcmp(argv[i], "-t") && i + 1 < argc)
+            opt.threads = (unsigned int)std::atoi(argv[++i]);
+        else if(argv[i][0] == '-')
+        {
+            std::fprintf(stderr, "usage: %s [-s megabytes] [-n runs] [-t threads] [wide|deep|numeric|strings|sparse|ndjson ...]\n", argv[0]);
+            return 1;
+        }
+        else
+            datasets.push_back(argv[i]);
+    }
+    if(opt.runs < 1)
+        opt.runs = 1;
+    if(datasets.empty())
+    {
+        const char *const all[] = { "wide", "deep", "numeric", "strings", "sparse", "ndjson" };
+        datasets.assign(all, all + 6);
+    }
+
+    for(size_t i = 0; i < datasets.size(); ++i)
+    {
+        const std::string &name = datasets[i];
+        if(name == "wide")
+            bench_document<WideDoc>(opt, "wide", generate_wide);
+        else if(name == "deep")
+            bench_document<DeepDoc>(opt, "deep", generate_deep);
+        else if(name == "numeric")
+            bench_document<NumericDoc>(opt, "numeric", generate_numeric);
+        else if(name == "strings")
+            bench_document<StringDoc>(opt, "strings", generate_strings);
+        else if(name == "sparse")
+            bench_sparse(opt);
+        else if(name == "ndjson")
+            bench_ndjson(opt);
+        else
+            std::fprintf(stderr, "unknown dataset: %s\n", name.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,614 @@
+/*
+ * Differential fuzz test for the nanojson decoders
+ *
+ *   g++ -std=c++11 -O2 -pthread -I. -o fuzz fuzz.cpp
+ *   ./fuzz [-n documents] [-s seed] [-v]
+ *
+ * Random documents and mutations of them are mapped by every decoder: the
+ * typed decoder generated for the struct, mapping_context (set_threads), the
+ * structural index (set_indexed), push_parser fed in random pieces, and
+ * picojson::value. All of them must accept or reject the same documents and
+ * produce the same struct. Each decoder keeps reading into the same struct, so
+ * what a document leaves behind must not show up in the next one, and the
+ * picojson::value is mapped twice. lazy<T> has to agree as well, except that it
+ * does not report absent members of the root. The three text decoders of reader must also agree
+ * on the error code and path. Every 256th document holds an array large enough
+ * to be mapped in parallel, or an empty one padded with as much whitespace.
+ * Accepted structs are written as MessagePack and CBOR and must read back the
+ * same, while a message cut short must be rejected. Every 32 documents go
+ * through both forms of ndjson_reader::parse_all, which must keep exactly the
+ * records the typed decoder accepts.
+ * Exits with 1 at the first disagreement, after printing the document.
+ */
+
+#include "nanojson.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Leaf : public nanojson::object<Leaf>
+{
+    def(int, id);
+    def(std::string, name);
+    def(double, score);
+};
+
+struct Root : public nanojson::object<Root>
+{
+    def(signed char, small);
+    def(unsigned short, port);
+    def(bool, flag);
+    def(double, ratio);
+    def(std::string, text);
+    def(std::vector<int>, ints);
+    def(std::vector<std::vector<double> >, grid);
+    def(std::vector<Leaf>, leaves);
+    def(Leaf, child);
+    def(Leaf *, none);
+};
+
+/* xorshift64*, so that a seed gives the same documents everywhere */
+class xorshift
+{
+private:
+    unsigned long long s;
+public:
+    xorshift(const unsigned long long seed) : s(seed * 2685821657736338717ULL | 1) { }
+
+    unsigned long long next()
+    {
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        return s * 2685821657736338717ULL;
+    }
+
+    inline size_t below(const size_t n) { return static_cast<size_t>(next() % n); }
+    inline bool chance(const size_t percent) { return below(100) < percent; }
+};
+
+/* documents which mostly fit Root, with some wrong types, missing members, unknown keys and bad numbers */
+class generator
+{
+private:
+    xorshift &rnd;
+    std::string out;
+    bool clean;         // every value so far fits its member
+    bool duplicate;     // the document repeats a key
+
+    void integer(const long long lo, const long long hi)
+    {
+        char buf[32];
+        long long v = lo + static_cast<long long>(rnd.below(static_cast<size_t>(hi - lo + 1)));
+        if(rnd.chance(3))
+        {
+            clean = false;
+            v = rnd.chance(50) ? hi + 1 + static_cast<long long>(rnd.below(1000)) : lo - 1 - static_cast<long long>(rnd.below(1000));
+        }
+        std::snprintf(buf, sizeof(buf), "%lld", v);
+        out += buf;
+    }
+
+    void number()
+    {
+        static const char *const forms[] = { "0", "-0", "1.5", "-2.25e3", "1E-2", "3.0", "12345678901234567890", "1e400", "-7" };
+        if(rnd.chance(30))
+        {
+            out += forms[rnd.below(sizeof(forms) / sizeof(forms[0]))];
+            return;
+        }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.6g", (static_cast<double>(rnd.below(2000000)) - 1000000) / 1000);
+        out += buf;
+    }
+
+    void text()
+    {
+        static const char *const pieces[] = { "a", "bc", " ", "\\\"", "\\\\", "\\n", "\\u00e9", "\\ud83d\\ude00", "/", "\\/", "xyz", "]}", "\xc3\xa9" };
+        out += '"';
+        for(size_t i = rnd.below(6); i; --i)
+            out += pieces[rnd.below(sizeof(pieces) / sizeof(pieces[0]))];
+        out += '"';
+    }
+
+    /* any JSON value, for unknown keys and wrong types */
+    void any(const int depth)
+    {
+        switch(rnd.below(depth > 3 ? 5 : 7))
+        {
+            case 0: out += "null"; break;
+            case 1: out += rnd.chance(50) ? "true" : "false"; break;
+            case 2: number(); break;
+            case 3: integer(-100, 100); break;
+            case 4: text(); break;
+            case 5:
+                out += '[';
+                for(size_t i = 0, n = rnd.below(4); i < n; ++i)
+                {
+                    if(i)
+                        out += ',';
+                    any(depth + 1);
+                }
+                out += ']';
+                break;
+            default:
+                out += '{';
+                for(size_t i = 0, n = rnd.below(4); i < n; ++i)
+                {
+                    if(i)
+                        out += ',';
+                    text();
+                    out += ':';
+                    any(depth + 1);
+                }
+                out += '}';
+                break;
+        }
+    }
+
+    /* a value of the expected kind, or rarely anything */
+    bool wrong()
+    {
+        if(!rnd.chance(2))
+            return false;
+        clean = false;
+        any(2);
+        return true;
+    }
+
+    void key(const char *name)
+    {
+        out += '"';
+        out += name;
+        out += "\":";
+        if(rnd.chance(20))
+            out += ' ';
+    }
+
+    void leaf()
+    {
+        if(wrong())
+            return;
+        out += '{';
+        bool first = true;
+        if(member(first, "id") && !wrong())
+            integer(-1000, 1000);
+        if(member(first, "name") && !wrong())
+            text();
+        if(member(first, "score") && !wrong())
+            number();
+        out += '}';
+    }
+
+    /* writes the key unless the member is left out. returns whether the value should follow */
+    bool member(bool &first, const char *name)
+    {
+        if(rnd.chance(2))
+        {
+            clean = false;
+            return false;
+        }
+        if(!first)
+            out += ',';
+        first = false;
+        if(rnd.chance(5))
+        {
+            // an unknown key before the member
+            text();
+            out += ':';
+            any(1);
+            out += ',';
+        }
+        key(name);
+        return true;
+    }
+
+    template<typename F>
+    void array(const size_t max, F elem)
+    {
+        if(wrong())
+            return;
+        out += '[';
+        for(size_t i = 0, n = rnd.below(max + 1); i < n; ++i)
+        {
+            if(i)
+                out += rnd.chance(5) ? " , " : ",";
+            elem();
+        }
+        out += ']';
+    }
+public:
+    generator(xorshift &rnd) : rnd(rnd) { }
+
+    std::string document(const size_t large)
+    {
+        out.clear();
+        clean = true;
+        duplicate = false;
+        out += rnd.chance(10) ? " {" : "{";
+        bool first = true;
+        if(member(first, "small") && !wrong())
+            integer(-128, 127);
+        if(member(first, "port") && !wrong())
+            integer(0, 65535);
+        if(member(first, "flag") && !wrong())
+            out += rnd.chance(50) ? "true" : "false";
+        if(member(first, "ratio") && !wrong())
+            number();
+        if(member(first, "text") && !wrong())
+            text();
+        if(member(first, "ints"))
+        {
+            if(large && rnd.chance(25))
+            {
+                // an empty array padded past the size that would be mapped in parallel
+                out += '[';
+                out.append(large * 8, rnd.chance(50) ? ' ' : '\n');
+                out += ']';
+            }
+            else if(large)
+            {
+                out += '[';
+                for(size_t i = 0; i < large; ++i)
+                {
+                    if(i)
+                        out += ',';
+                    integer(-100000, 100000);
+                }
+                out += ']';
+            }
+            else
+                array(8, [this]() { integer(-100000, 100000); });
+        }
+        if(member(first, "grid"))
+            array(3, [this]() { array(3, [this]() { number(); }); });
+        if(member(first, "leaves"))
+            array(4, [this]() { leaf(); });
+        if(member(first, "child"))
+            leaf();
+        if(rnd.chance(50) && member(first, "none") && !wrong())
+            out += "null";
+        if(clean && rnd.chance(10))
+        {
+            // a duplicate key, the last value wins. picojson::value only keeps the last one, so the
+            // streaming decoders would see an error in the first that the value never does
+            duplicate = true;
+            out += first ? "" : ",";
+            key("small");
+            integer(-128, 127);
+        }
+        out += rnd.chance(10) ? "} " : "}";
+        return out;
+    }
+
+    /* mutations could break the first value of a repeated key */
+    inline bool has_duplicate() const { return duplicate; }
+
+    /* a few random edits of doc */
+    void mutate(std::string &doc)
+    {
+        static const char bytes[] = "{}[],:\"\\0123456789.-+eEtrufalsn \t\n";
+        for(size_t edits = 1 + rnd.below(3); edits && !doc.empty(); --edits)
+        {
+            const size_t at = rnd.below(doc.size());
+            switch(rnd.below(5))
+            {
+                case 0:
+                    doc[at] = bytes[rnd.below(sizeof(bytes) - 1)];
+                    break;
+                case 1:
+                    doc.erase(at, 1 + rnd.below(3));
+                    break;
+                case 2:
+                    doc.insert(at, 1, bytes[rnd.below(sizeof(bytes) - 1)]);
+                    break;
+                case 3:
+                    doc.resize(at);
+                    break;
+                default:
+                    doc.insert(at, doc.substr(rnd.below(doc.size()), rnd.below(8)));
+                    break;
+            }
+        }
+    }
+};
+
+struct outcome
+{
+    const char *decoder;
+    bool ok;
+    nanojson::error_info err;
+    std::string result;     // the struct written back as JSON
+};
+
+static std::string dump(const Root &r)
+{
+    nanojson::writer w;
+    w.write(r);
+    return w.str();
+}
+
+/* every decoder reads into its own Root, which still holds the previous document */
+static outcome run_reader(const char *name, nanojson::reader &r, Root &root, const std::string &doc)
+{
+    outcome o;
+    o.decoder = name;
+    o.ok = r.parse_into(root, doc.data(), doc.size(), o.err);
+    if(o.ok)
+        o.result = dump(root);
+    return o;
+}
+
+static outcome run_push(Root &root, const std::string &doc, xorshift &rnd)
+{
+    outcome o;
+    o.decoder = "push_parser";
+    nanojson::push_parser<Root> parser(root);
+    o.ok = true;
+    for(size_t p = 0; o.ok && p < doc.size(); )
+    {
+        const size_t n = rnd.chance(20) ? doc.size() - p : 1 + rnd.below(doc.size() - p < 16 ? doc.size() - p : 16);
+        o.ok = parser.feed(doc.data() + p, n);
+        p += n;
+    }
+    o.ok = o.ok && parser.finish();
+    if(o.ok)
+        o.result = dump(root);
+    return o;
+}
+
+static outcome run_value(nanojson::reader &r, Root &root, const std::string &doc)
+{
+    outcome o;
+    o.decoder = "picojson::value";
+    picojson::value v;
+    std::string err;
+    const char *end = picojson::parse(v, doc.data(), doc.data() + doc.size(), &err);
+    o.ok = err.empty() && picojson::_scanners<bool>::skip_ws(end, doc.data() + doc.size()) == doc.data() + doc.size();
+    if(o.ok)
+    {
+        o.ok = r.parse_into(root, v, o.err);
+        if(o.ok)
+        {
+            // reading the same value again must not change anything
+            o.result = dump(root);
+            if(!r.parse_into(root, v, o.err) || dump(root) != o.result)
+                o.result = "changed by a second parse_into: " + dump(root);
+        }
+    }
+    return o;
+}
+
+/* lazy only decodes when asked, so every member is decoded through all() */
+static outcome run_lazy(nanojson::reader &r, const std::string &doc)
+{
+    outcome o;
+    o.decoder = "lazy";
+    nanojson::lazy<Root> l;
+    try
+    {
+        r.parse_lazy(l, doc.data(), doc.size());
+        o.result = dump(l.all());
+        o.ok = true;
+    }
+    catch(const nanojson::exception &)
+    {
+        o.ok = false;
+    }
+    return o;
+}
+
+/* the typed result written as MessagePack or CBOR and read back into root. a message cut short has to be
+   rejected, and the failed read must not leave anything behind for the complete one */
+template<typename Writer, typename Reader>
+static outcome run_binary(const char *name, const Root &src, Root &root, xorshift &rnd)
+{
+    outcome o;
+    o.decoder = name;
+    Writer w;
+    w.write(src);
+    Reader r;
+    const size_t cut = rnd.below(w.size());
+    if(r.parse_into(root, w.data(), cut, o.err))
+    {
+        o.ok = true;
+        o.result = "accepted a message cut short: " + dump(root);
+        return o;
+    }
+    o.ok = r.parse_into(root, w.data(), w.size(), o.err);
+    if(o.ok)
+        o.result = r.consumed() == w.size() ? dump(root) : "stopped inside the message";
+    return o;
+}
+
+/* parse_all has to keep the records the typed decoder accepts, in order, and report the others. as NDJSON,
+   documents holding a line break or nothing but whitespace are left out, since they are not one record */
+static bool run_batch(const std::vector<std::string> &docs, const std::vector<outcome> &typed, std::vector<Root> &out,
+    const bool lines)
+{
+    std::vector<size_t> index;      // the document of each record
+    std::vector<nanojson::batch_error> errors;
+    if(lines)
+    {
+        std::string buffer;
+        for(size_t i = 0; i < docs.size(); ++i)
+        {
+            if(docs[i].find('\n') != std::string::npos || docs[i].find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            buffer += docs[i];
+            buffer += '\n';
+            index.push_back(i);
+        }
+        errors = nanojson::ndjson_reader<Root>::parse_all(buffer.data(), buffer.size(), out, 2);
+        for(size_t e = 0; e < errors.size(); ++e)
+            --errors[e].index;      // line numbers start from 1
+    }
+    else
+    {
+        for(size_t i = 0; i < docs.size(); ++i)
+            index.push_back(i);
+        errors = nanojson::ndjson_reader<Root>::parse_all(docs, out, 2);
+    }
+
+    size_t record = 0, error = 0;
+    for(size_t k = 0; k < index.size(); ++k)
+    {
+        const outcome &o = typed[index[k]];
+        const bool failed = error < errors.size() && errors[error].index == k;
+        error += failed;
+        if(o.ok == failed || (o.ok && (record == out.size() || dump(out[record++]) != o.result)))
+        {
+            const std::string &doc = docs[index[k]];
+            std::printf("parse_all (%s) disagrees with the typed decoder (%s) for:\n%s\n", lines ? "NDJSON" : "documents",
+                o.ok ? "ok" : "failed", doc.size() > 4096 ? (doc.substr(0, 4096) + "...").c_str() : doc.c_str());
+            return false;
+        }
+    }
+    if(record != out.size() || error != errors.size())
+    {
+        std::printf("parse_all (%s) returned %zu records and %zu errors for %zu documents\n", lines ? "NDJSON" : "documents",
+            out.size(), errors.size(), index.size());
+        return false;
+    }
+    return true;
+}
+
+/* whether lazy has to notice the error too. it does not report absent members of the root */
+static bool lazy_reports(const nanojson::error_info &err)
+{
+    return err.code != nanojson::error_info::missing_member || err.path.find('/', 1) != std::string::npos;
+}
+
+/* a valid root element followed by more than whitespace */
+static bool trailing_data(const std::string &doc)
+{
+    picojson::null_parse_context ctx;
+    std::string err;
+    const char *end = picojson::_parse(ctx, doc.data(), doc.data() + doc.size(), &err);
+    return err.empty() && picojson::_scanners<bool>::skip_ws(end, doc.data() + doc.size()) != doc.data() + doc.size();
+}
+
+static void report(const std::string &doc, const outcome *o, const size_t n, const char *what)
+{
+    std::printf("decoders disagree on %s for:\n%s\n", what, doc.size() > 4096 ? (doc.substr(0, 4096) + "...").c_str() : doc.c_str());
+    for(size_t i = 0; i < n; ++i)
+    {
+        std::printf("  %-16s %s", o[i].decoder, o[i].ok ? "ok" : "failed");
+        if(!o[i].ok && o[i].err.code != nanojson::error_info::ok)
+            std::printf(" (%s %s)", o[i].err.message(), o[i].err.path.c_str());
+        std::printf("\n");
+        if(o[i].ok && o[i].result.size() < 4096)
+            std::printf("    %s\n", o[i].result.c_str());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t documents = 20000;
+    unsigned long long seed = 1;
+    bool verbose = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "-n") && i + 1 < argc)
+            documents = std::strtoul(argv[++i], 0, 10);
+        else if(!std::strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = std::strtoull(argv[++i], 0, 10);
+        else if(!std::strcmp(argv[i], "-v"))
+            verbose = true;
+        else
+        {
+            std::fprintf(stderr, "usage: %s [-n documents] [-s seed] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    xorshift rnd(seed);
+    generator gen(rnd);
+    nanojson::reader typed, threaded, indexed, mapper;
+    Root roots[7];
+    std::vector<std::string> batch;
+    std::vector<outcome> batch_typed;
+    std::vector<Root> records[2];
+    threaded.set_threads(2);
+    indexed.set_indexed(true);
+
+    size_t accepted = 0;
+    for(size_t i = 0; i < documents; ++i)
+    {
+        std::string doc = gen.document(i % 256 == 255 ? 200000 : 0);
+        if(!gen.has_duplicate() && rnd.chance(60))
+            gen.mutate(doc);
+
+        outcome o[6] =
+        {
+            run_reader("typed", typed, roots[0], doc),
+            run_reader("set_threads", threaded, roots[1], doc),
+            run_reader("set_indexed", indexed, roots[2], doc),
+            run_push(roots[3], doc, rnd),
+            run_value(mapper, roots[4], doc),
+            run_lazy(mapper, doc)
+        };
+        const size_t n = sizeof(o) / sizeof(o[0]) - 1;
+        const outcome &lazy = o[n];
+
+        bool same = true;
+        // every decoder rejects anything after the root element, the comparisons below check that they agree
+        if(o[0].ok && trailing_data(doc))
+        {
+            report(doc, o, n + 1, "data after the root element");
+            return 1;
+        }
+        for(size_t k = 1; k < n; ++k)
+            same = same && o[k].ok == o[0].ok && o[k].result == o[0].result;
+        if(!same)
+        {
+            report(doc, o, n, "the result");
+            return 1;
+        }
+        if(o[0].ok ? !lazy.ok || lazy.result != o[0].result : lazy.ok && lazy_reports(o[0].err))
+        {
+            report(doc, o, n + 1, "the lazily decoded result");
+            return 1;
+        }
+        // reader classifies every failure the same way, whichever decoder found it
+        for(size_t k = 1; k < 3; ++k)
+            same = same && o[k].err.code == o[0].err.code && o[k].err.path == o[0].err.path;
+        if(!same)
+        {
+            report(doc, o, 3, "the error");
+            return 1;
+        }
+        if(o[0].ok)
+        {
+            outcome b[3] =
+            {
+                o[0],
+                run_binary<nanojson::msgpack_writer, nanojson::msgpack_reader>("msgpack", roots[0], roots[5], rnd),
+                run_binary<nanojson::cbor_writer, nanojson::cbor_reader>("cbor", roots[0], roots[6], rnd)
+            };
+            if(!b[1].ok || b[1].result != o[0].result || !b[2].ok || b[2].result != o[0].result)
+            {
+                report(doc, b, 3, "the MessagePack or CBOR round trip");
+                return 1;
+            }
+        }
+
+        batch.push_back(doc);
+        batch_typed.push_back(o[0]);
+        if(batch.size() == 32 || i + 1 == documents)
+        {
+            if(!run_batch(batch, batch_typed, records[0], true) || !run_batch(batch, batch_typed, records[1], false))
+                return 1;
+            batch.clear();
+            batch_typed.clear();
+        }
+
+        if(verbose && !o[0].ok)
+            std::printf("%s %s: %s\n", o[0].err.message(), o[0].err.path.c_str(), doc.size() > 200 ? "(large)" : doc.c_str());
+        accepted += o[0].ok;
+    }
+    std::printf("%zu documents, %zu accepted, all decoders agree\n", documents, accepted);
+    return 0;
+}
@@ -7,15 +7,79 @@
 #include <string>
 #include <vector>
 #include <limits>
+#include <cstddef>
+#include <cstring>
+#include <clocale>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NANOJSON_POSIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#if __cplusplus >= 201103L
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <system_error>
+#endif
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#ifdef NANOJSON_STATS
+#include <map>
+#include <typeinfo>
+#include <ctime>
+#if __cplusplus >= 201103L
+#include <chrono>
+#endif
+#endif
+
+#ifndef NANOJSON_MAX_MEMBERS
+#define NANOJSON_MAX_MEMBERS 256
+#endif
+
+#if __cplusplus >= 201103L
+#define NANOJSON_NOEXCEPT noexcept
+#else
+#define NANOJSON_NOEXCEPT
+#endif
 
 namespace nanojson
 {
     struct _member_info;
-    typedef std::vector<_member_info *> _pos_list;
+    struct _pos_list;
+    class writer;
+
+    template<typename C>
+    class _members;
 
-    typedef const char *(*_f_get_name)();
-    typedef void (*_set_value)(void *, const void *);
-    typedef void (*_array_ctor)(void *, picojson::array &);
+    /* the class holding the def declarations of C. NANOJSON_DESCRIBE specializes it
+       for types which do not derive from object */
+    template<typename C>
+    struct _describe { typedef C type; };
+
+    typedef bool (*_set_value)(void *, const void *);
+    typedef bool (*_set_integer)(void *, bool, uint64_t);
+    struct error_info;
+
+    typedef bool (*_array_ctor)(void *, picojson::array &, error_info *);
+    typedef void *(*_array_push)(void *);
+    typedef size_t (*_array_size)(const void *);
+    typedef void (*_array_resize)(void *, size_t);
+    typedef const void *(*_array_at)(const void *, size_t);
+    typedef void (*_array_store_bit)(void *, size_t, bool);
+    typedef void (*_write_value)(writer &, const void *);
+    typedef void (*_reset_value)(void *);
 
     namespace _json_values
     {
@@ -41,6 +105,7 @@ namespace nanojson
         int line;
     public:
         exception() { }
+        ~exception() throw() { }
         exception(const char *message, const char *fileName, const char *funcName, const int line) :
             message(message), fileName(fileName), funcName(funcName), line(line) { }
 
@@ -52,17 +117,312 @@ namespace nanojson
 
 #define __exception(MSG) exception(MSG, __FILE__, __FUNCTION__, __LINE__)
 
+    /* why a parse failed, filled by the functions which report errors instead of throwing */
+    struct error_info
+    {
+        enum code_type
+        {
+            ok,
+            syntax_error,       // the input is not JSON
+            type_mismatch,      // the value cannot be stored into the member
+            out_of_range,       // the number does not fit the member
+            missing_member,     // a member is absent from picojson::value
+            not_object,         // the root element is not an object
+            open_failed,        // the file cannot be opened
+            out_of_memory,      // std::bad_alloc, or std::length_error from a container
+            internal_error      // any other exception, e.g. thrown by a member's own code
+        };
+
+        code_type code;
+        size_t offset;          // where parsing stopped, in bytes from the start of the input. 0 for picojson::value
+        std::string path;       // JSON Pointer of the value which failed, e.g. /list/3/age. empty for the root
+
+        error_info() : code(ok), offset(0) { }
+
+        inline void clear()
+        {
+            code = ok;
+            offset = 0;
+            path.clear();
+        }
+
+        inline const char *message() const
+        {
+            switch(code)
+            {
+                case ok:                return "no error";
+                case syntax_error:      return "syntax error";
+                case type_mismatch:     return "type mismatch";
+                case out_of_range:      return "number out of range";
+                case missing_member:    return "member not found";
+                case not_object:        return "root element must be object";
+                case open_failed:       return "failed to open file";
+                case out_of_memory:     return "out of memory";
+                case internal_error:    return "internal error";
+            }
+            return "unknown error";
+        }
+
+        /* paths are built from the innermost value outwards, while a failed parse returns */
+        void _prepend(const char *key, const size_t len)
+        {
+            std::string seg(1, '/');
+            for(size_t i = 0; i < len; ++i)
+            {
+                if(key[i] == '~')
+                    seg += "~0";
+                else if(key[i] == '/')
+                    seg += "~1";
+                else
+                    seg += key[i];
+            }
+            path.insert(0, seg);
+        }
+
+        void _prepend(size_t index)
+        {
+            char buf[24], *p = buf + sizeof(buf);
+            do
+            {
+                *--p = static_cast<char>('0' + index % 10);
+                index /= 10;
+            }
+            while(index != 0);
+            *--p = '/';
+            path.insert(0, p, buf + sizeof(buf) - p);
+        }
+    };
+
+    /* the code of the exception being handled, for the functions which report errors instead of throwing */
+    inline error_info::code_type _exception_code()
+    {
+        try
+        {
+            throw;
+        }
+        catch(const std::bad_alloc &)
+        {
+            return error_info::out_of_memory;
+        }
+        catch(const std::length_error &)
+        {
+            return error_info::out_of_memory;
+        }
+        catch(...)
+        {
+            return error_info::internal_error;
+        }
+    }
+
+    /* a string which refers to memory owned by someone else, usually a document */
+    class str_ref
+    {
+    private:
+        const char *ptr;
+        size_t len;
+    public:
+        str_ref() : ptr(""), len(0) { }
+        str_ref(const char *str, const size_t len) : ptr(str), len(len) { }
+        str_ref(const char *str) : ptr(str), len(strlen(str)) { }
+        str_ref(const std::string &str) : ptr(str.data()), len(str.size()) { }
+
+        inline const char *data() const { return ptr; }
+        inline size_t size() const { return len; }
+        inline bool empty() const { return len == 0; }
+        inline const char *begin() const { return ptr; }
+        inline const char *end() const { return ptr + len; }
+        inline char operator[](const size_t i) const { return ptr[i]; }
+        inline std::string str() const { return std::string(ptr, len); }
+#if __cplusplus >= 201703L
+        inline operator std::string_view() const { return std::string_view(ptr, len); }
+#endif
+
+        friend inline bool operator==(const str_ref &a, const str_ref &b)
+        {
+            return a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+        }
+        friend inline bool operator!=(const str_ref &a, const str_ref &b) { return !(a == b); }
+        friend inline bool operator<(const str_ref &a, const str_ref &b)
+        {
+            const int c = memcmp(a.ptr, b.ptr, a.len < b.len ? a.len : b.len);
+            return c != 0 ? c < 0 : a.len < b.len;
+        }
+        friend inline std::ostream &operator<<(std::ostream &os, const str_ref &r) { return os.write(r.ptr, r.len); }
+    };
+
+    /* storage for the strings which can not refer to the input, i.e. the ones with escapes */
+    class _string_pool
+    {
+    private:
+        picojson::arena mem;
+#if __cplusplus >= 201103L
+        std::mutex lock;
+#endif
+    public:
+        str_ref store(const std::string &str)
+        {
+#if __cplusplus >= 201103L
+            std::lock_guard<std::mutex> guard(lock);
+#endif
+            if(str.empty())
+                return str_ref();
+            char *p = static_cast<char *>(mem.allocate(str.size()));
+            memcpy(p, str.data(), str.size());
+            return str_ref(p, str.size());
+        }
+
+        inline void clear() { mem.clear(); }
+    };
+
     struct _member_info
     {
-        _f_get_name n;
+        const char *name;
+        size_t name_len;
         union
         {
             _set_value s;
-            _pos_list *list;
+            const _pos_list *list;
             _array_ctor ctor;
         };
+        _set_integer si;            // stores an exact integer (int_type and double_type only)
+        _array_push push;           // appends a default element and returns it (array_type only)
+        _array_size size;           // number of elements (array_type only)
+        _array_resize resize;       // changes the number of elements (array_type only)
+        _array_at at;               // address of an element (array_type only, read only for std::vector<bool>)
+        _array_store_bit store_bit; // std::vector<bool> only, whose elements have no address: sets element i,
+                                    // appending when i is the size. push is 0 then
+        const _member_info *elem;   // describes the element type (array_type only)
+        _write_value w;             // serializes the value (types other than array and object)
+        _reset_value reset;         // empties the value, keeping the capacity of strings and vectors
         size_t pos;
         _json_values::type type;
+        bool ref;                   // string_type which refers into the input instead of owning a copy
+    };
+
+    /* members of a type in declaration order, with a perfect hash of their names */
+    struct _pos_list
+    {
+        const _member_info *members;
+        size_t count;
+        unsigned short *slots;      // member index + 1 for each hash slot, 0 if empty
+        unsigned int seed;
+        unsigned int shift;
+        bool full_hash;             // false: hash only the length, first and last char
+#ifdef NANOJSON_STATS
+        const char *type_name;      // typeid(C).name(), for stats::objects
+#endif
+
+        inline const _member_info *begin() const { return members; }
+        inline const _member_info *end() const { return members + count; }
+        inline bool empty() const { return count == 0; }
+
+        inline unsigned int hash(const char *key, const size_t len) const
+        {
+            unsigned int h;
+            if(full_hash)
+            {
+                h = 2166136261u;
+                for(size_t i = 0; i < len; ++i)
+                    h = (h ^ static_cast<unsigned char>(key[i])) * 16777619u;
+            }
+            else if(len == 0)
+                h = 0;
+            else
+                h = static_cast<unsigned int>(len << 16) ^
+                    (static_cast<unsigned char>(key[0]) << 8) ^
+                    static_cast<unsigned char>(key[len - 1]);
+            return ((h ^ (h >> 15)) * seed) >> shift;
+        }
+
+        inline const _member_info *find(const char *key, const size_t len) const
+        {
+            if(count == 0)
+                return 0;
+            if(seed == 0)
+                return find_linear(key, len);
+            const unsigned short slot = slots[hash(key, len)];
+            if(slot == 0)
+                return 0;
+            const _member_info *mi = members + slot - 1;
+            return mi->name_len == len && memcmp(mi->name, key, len) == 0 ? mi : 0;
+        }
+
+        /* searches a seed which maps every name to its own slot. capacity must be a power of 2 */
+        void build_index(unsigned short *table, const size_t capacity)
+        {
+            slots = table;
+            for(int mode = 0; mode < 2; ++mode)
+            {
+                full_hash = mode != 0;
+                size_t size = 2, bits = 1;
+                while(size < count * 2)
+                {
+                    size <<= 1;
+                    ++bits;
+                }
+                for(; size <= capacity; size <<= 1, ++bits)
+                {
+                    shift = 32 - static_cast<unsigned int>(bits);
+                    unsigned int candidate = 0x9e3779b1u;
+                    for(int trial = 0; trial < 256; ++trial, candidate = candidate * 1664525u + 1013904223u)
+                    {
+                        seed = candidate | 1;
+                        if(try_seed(size))
+                            return;
+                    }
+                }
+            }
+            // no perfect hash found within capacity. fall back to linear search
+            seed = 0;
+        }
+    private:
+        const _member_info *find_linear(const char *key, const size_t len) const
+        {
+            for(const _member_info *mi = begin(); mi != end(); ++mi)
+            {
+                if(mi->name_len == len && memcmp(mi->name, key, len) == 0)
+                    return mi;
+            }
+            return 0;
+        }
+
+        bool try_seed(const size_t size)
+        {
+            memset(slots, 0, size * sizeof(unsigned short));
+            for(size_t i = 0; i < count; ++i)
+            {
+                unsigned short &slot = slots[hash(members[i].name, members[i].name_len)];
+                if(slot != 0)
+                    return false;
+                slot = static_cast<unsigned short>(i + 1);
+            }
+            return true;
+        }
+    };
+
+    /* the members of one object mapped so far, so that the missing ones can be told when it closes.
+       a member given twice is counted once */
+    struct _seen_members
+    {
+        size_t found;
+        uint32_t bits[(NANOJSON_MAX_MEMBERS + 31) / 32];
+
+        inline void clear(const size_t count)
+        {
+            found = 0;
+            memset(bits, 0, (count + 31) / 32 * sizeof(uint32_t));
+        }
+
+        inline void add(const size_t i)
+        {
+            const uint32_t bit = static_cast<uint32_t>(1) << (i % 32);
+            if(bits[i / 32] & bit)
+                return;
+            bits[i / 32] |= bit;
+            ++found;
+        }
+
+        inline bool has(const size_t i) const { return (bits[i / 32] >> (i % 32)) & 1; }
     };
 
     namespace _type_checker
@@ -110,17 +470,54 @@ namespace nanojson
         template<typename T>
         struct _is_pointer<T *> : public _true_type { };
 
+        template<typename T>
+        struct _is_string_ref : public _false_type { };
+
+        template<>
+        struct _is_string_ref<str_ref> : public _true_type { };
+
+#if __cplusplus >= 201703L
+        template<>
+        struct _is_string_ref<std::string_view> : public _true_type { };
+#endif
+
         template<typename T>
         struct _is_vector : public _false_type { };
 
         template<typename T, typename A>
         struct _is_vector<std::vector<T, A> > : public _true_type { };
 
+        template<typename T>
+        struct _is_bit_vector : public _false_type { };
+
+        template<typename A>
+        struct _is_bit_vector<std::vector<bool, A> > : public _true_type { };
+
         template<typename T, typename U = void>
         struct _has_self_type : public _false_type { };
 
         template<typename T>
-        struct _has_self_type<T, typename _type_checker::_ignore<typename T::self_type>::type> : public _true_type { };
+        struct _has_self_type<T, typename _type_checker::_ignore<typename _describe<T>::type::self_type>::type>
+            : public _true_type { };
+
+        /* compile time counter used by def. _rank<N> converts to the nearest declared _rank */
+        template<int N>
+        struct _rank : public _rank<N - 1> { };
+
+        template<>
+        struct _rank<0> { };
+
+        template<int N>
+        struct _counter { char c[N + 1]; };
+
+        template<int N>
+        struct _index { };
+
+        template<unsigned int N, unsigned int P = 1, bool D = (P >= N)>
+        struct _ceil_pow2 { static const unsigned int value = _ceil_pow2<N, P * 2>::value; };
+
+        template<unsigned int N, unsigned int P>
+        struct _ceil_pow2<N, P, true> { static const unsigned int value = P; };
 
         template<typename T>
         struct get_type
@@ -138,7 +535,7 @@ namespace nanojson
                             std::numeric_limits<T>::is_iec559,
                             _elem<_json_values::double_type>,
                             _if<
-                                _is_same<T, std::string>::value,
+                                _is_same<T, std::string>::value || _is_string_ref<T>::value,
                                 _elem<_json_values::string_type>,
                                 _if<
                                     _is_vector<T>::value,
@@ -155,242 +552,4940 @@ namespace nanojson
                 >
             >::value::val;
         };
+
+        /* whether T holds a str_ref or string_view at any depth. recursive types are followed D levels deep */
+        template<typename T, int D = 16, _json_values::type K = get_type<T>::value>
+        struct _has_views
+        {
+            static const bool value = _is_string_ref<T>::value;
+        };
+
+        template<typename T, int D>
+        struct _has_views<T *, D, _json_values::null_type> : public _has_views<T, D> { };
+
+        template<typename T, typename A, int D>
+        struct _has_views<std::vector<T, A>, D, _json_values::array_type> : public _has_views<T, D> { };
+
+        template<typename C, int D, int I, int N, bool E = (I >= N || D <= 0)>
+        struct _member_views
+        {
+            template<typename F>
+            static _counter<_has_views<typename F::value_type, D - 1>::value> check(F *);
+
+            static const bool value = sizeof(check(_describe<C>::type::_member(static_cast<_index<I> *>(0)))) != sizeof(_counter<0>)
+                || _member_views<C, D, I + 1, N>::value;
+        };
+
+        template<typename C, int D, int I, int N>
+        struct _member_views<C, D, I, N, true> : public _false_type { };
+
+        template<typename T, int D>
+        struct _has_views<T, D, _json_values::object_type>
+            : public _member_views<T, D, 0,
+                sizeof(_describe<T>::type::_count_members(static_cast<_rank<NANOJSON_MAX_MEMBERS> *>(0))) - 1> { };
+
+        /* left incomplete for true, so that sizeof stops the build before C++11 has static_assert */
+        template<bool B>
+        struct _views_need_document { };
+
+        template<>
+        struct _views_need_document<true>;
     };
 
-    namespace _parser_funcs
+#if __cplusplus >= 201103L
+    /* a record which could not be parsed by the batch functions */
+    struct batch_error
     {
-        /* parser functions */
-        void parse(void *result, _pos_list *list, picojson::object &obj);
+        size_t index;
+        std::string message;
+    };
 
-        void parse(void *o, _member_info *info, picojson::value &value)
+    namespace _parallel
+    {
+        inline unsigned int threads(const unsigned int n)
         {
-            switch(info->type)
+            const unsigned int t = n ? n : std::thread::hardware_concurrency();
+            return t ? t : 1;
+        }
+
+        /* runs f(i) for every i in [0, n). idle threads take the next task from a shared counter,
+           so a few large tasks do not hold back the rest. the calling thread works too */
+        template<typename F>
+        void run(const size_t n, const unsigned int threads, F f)
+        {
+            std::atomic<size_t> next(0);
+            std::exception_ptr error;
+            std::mutex error_lock;
+
+            auto work = [&]()
             {
-                case _json_values::null_type:
-                    if(!value.is<picojson::null>())
-                        throw __exception("pointer value must be null");
-                    info->s(o, 0);
-                    break;
-                case _json_values::boolean_type:
-                    {
-                        const bool b = value.get<bool>();
-                        info->s(o, &b);
-                    }
-                    break;
-                case _json_values::int_type:
-                    {
-                        const int i = static_cast<int>(value.get<double>());
-                        info->s(o, &i);
-                    }
-                    break;
-                case _json_values::double_type:
-                    {
-                        const double d = value.get<double>();
-                        info->s(o, &d);
-                    }
-                    break;
-                case _json_values::string_type:
+                for(size_t i; (i = next.fetch_add(1)) < n; )
+                {
+                    try
                     {
-                        const std::string &s = value.get<std::string>();
-                        info->s(o, &s);
+                        f(i);
                     }
-                    break;
-                case _json_values::array_type:
-                    info->ctor(o, value.get<picojson::array>());
-                    break;
-                case _json_values::object_type:
+                    catch(...)
                     {
-                        picojson::object &children = value.get<picojson::object>();
-                        parse(o, info->list, children);
+                        std::lock_guard<std::mutex> lock(error_lock);
+                        if(!error)
+                            error = std::current_exception();
+                        next = n;
                     }
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for(size_t t = 1; t < threads && t < n; ++t)
+            {
+                try
+                {
+                    pool.emplace_back(work);
+                }
+                catch(const std::system_error &)
+                {
                     break;
-                case _json_values::error_type:
-                    throw __exception("error invalid member type");
-                    break;
-            }     
+                }
+            }
+            work();
+            for(std::thread &t : pool)
+                t.join();
+
+            if(error)
+                std::rethrow_exception(error);
         }
+    }
+#endif
+
+    /* declared members which are skipped like undeclared ones, for code paths which only need part of a struct.
+       skipped members are emptied, so a struct read again in place does not keep stale values */
+    class projection
+    {
+    private:
+        std::vector<const _member_info *> ignored;  // sorted
 
-        void parse(void *result, _pos_list *list, picojson::object &obj)
+        /* finds the member by its offset. like offsetof, the offset is taken on raw storage and no C is constructed */
+        template<typename C, typename M>
+        static const _member_info *find(M C::*m)
         {
-            for(_pos_list::iterator it = list->begin(); it != list->end(); ++it)
+            union
+            {
+                char raw[sizeof(C)];
+                long double ld;
+                long long ll;
+                void *p;
+                void (*f)();
+            } storage;
+            const C &probe = *reinterpret_cast<const C *>(storage.raw);
+            const size_t pos = reinterpret_cast<const char *>(&(probe.*m)) - storage.raw;
+            const _pos_list *list = _members<C>::get();
+            for(const _member_info *mi = list->begin(); mi != list->end(); ++mi)
             {
-                _member_info *info = *it;
-                parse(
-                    static_cast<char *>(result) + info->pos,
-                    info,
-                    obj[info->n()]
-                );
+                if(mi->pos == pos)
+                    return mi;
             }
+            throw __exception("member not declared by def.");
         }
-
-        template<typename T>
-        inline void parse(T &result, picojson::object &obj) { parse(&result, &T::_pos, obj); }
-
-        /* functions to assign value to vector */
-        template<typename T>
-        inline void assign(
-            void *v,
-            picojson::array &list,
-            typename _type_checker::_enable<
-                !std::numeric_limits<T>::is_integer &&
-                !_type_checker::_has_self_type<T>::value
-            >::type* = 0)
+    public:
+        template<typename C, typename M>
+        projection &ignore(M C::*m)
         {
-            for(picojson::array::iterator it = list.begin(); it != list.end(); ++it)
-                static_cast<std::vector<T> *>(v)->push_back(it->get<T>());
+            const _member_info *mi = find(m);
+            std::vector<const _member_info *>::iterator it =
+                std::lower_bound(ignored.begin(), ignored.end(), mi, std::less<const _member_info *>());
+            if(it == ignored.end() || *it != mi)
+                ignored.insert(it, mi);
+            return *this;
         }
 
-        template<typename T>
-        inline void assign(
-            void *v,
-            picojson::array &list,
-            typename _type_checker::_enable<_type_checker::_has_self_type<T>::value>::type* = 0
-        )
+        template<typename C, typename M>
+        projection &include(M C::*m)
         {
-            for(picojson::array::iterator it = list.begin(); it != list.end(); ++it)
-            {
-                T elem;
-                parse(elem, it->get<picojson::object>());
-                static_cast<std::vector<T> *>(v)->push_back(elem);
-            }
+            const _member_info *mi = find(m);
+            std::vector<const _member_info *>::iterator it =
+                std::lower_bound(ignored.begin(), ignored.end(), mi, std::less<const _member_info *>());
+            if(it != ignored.end() && *it == mi)
+                ignored.erase(it);
+            return *this;
         }
 
-        template<typename T>
-        inline void assign(
-            void *v,
-            picojson::array &list,
-            typename _type_checker::_enable<std::numeric_limits<T>::is_integer>::type* = 0
-        )
+        inline void clear() { ignored.clear(); }
+        inline bool empty() const { return ignored.empty(); }
+
+        inline bool ignores(const _member_info *mi) const
         {
-            for(picojson::array::iterator it = list.begin(); it != list.end(); ++it)
-                static_cast<std::vector<T> *>(v)->push_back(it->get<double>());
+            return !ignored.empty()
+                && std::binary_search(ignored.begin(), ignored.end(), mi, std::less<const _member_info *>());
         }
+    };
 
-        template<typename T>
-        inline void assign_bridge(void *v, picojson::array &list) { assign<T>(v, list); }
-    }
-
-    template<typename C, typename T>
-    class json_element
+#ifdef NANOJSON_STATS
+    /* counters collected by reader when NANOJSON_STATS is defined. times are in seconds */
+    struct stats
     {
-        template<typename S>
-        inline static void set_vparam(
-            _member_info &mi,
-            typename _type_checker::_enable<_type_checker::_has_self_type<S>::value>::type* = 0
-        ) { mi.list = &T::_pos; }
-
-        template<typename S>
-        inline static void set_vparam(
-            _member_info &mi,
-            typename _type_checker::_enable<_type_checker::_is_vector<S>::value>::type* = 0
-        ) { mi.ctor = _parser_funcs::assign_bridge<typename S::value_type>; }
+        double load_time;           // opening and mapping files
+        double index_time;          // building the structural index (set_indexed, parse_lazy)
+        double parse_time;          // tokenizing. the direct parser maps members while tokenizing, so mapping is included
+        double dom_time;            // building picojson::value in parse_value
+        double map_time;            // mapping through the structural index or from picojson::value
+        size_t documents;
+        size_t bytes;               // input bytes
+        size_t dom_nodes;           // picojson::value nodes built by parse_value
+        size_t values;              // members and array elements in the mapped results
+        size_t allocations;         // reported through count_allocation while parsing
+        size_t allocated_bytes;
+        std::map<std::string, size_t> objects;  // mapped objects by typeid(T).name()
 
-        template<typename S>
-        inline static void set_vparam(
-            _member_info &mi,
-            typename _type_checker::_enable<
-                !_type_checker::_has_self_type<S>::value &&
-                !_type_checker::_is_vector<S>::value
-            >::type* = 0
-        ) { mi.s = set; }
+        stats() { clear(); }
 
-        struct __initializer
+        void clear()
         {
-            __initializer()
-            {
-                _meminfo.n = C::_get_name;
-                set_vparam<T>(_meminfo);
-                C::_register(&_meminfo);
-            }
-        };
-    private:
-        static _member_info _meminfo;
+            load_time = index_time = parse_time = dom_time = map_time = 0;
+            documents = bytes = dom_nodes = values = allocations = allocated_bytes = 0;
+            objects.clear();
+        }
+    };
 
-        static void set(void *o, const void *v) { *static_cast<T *>(o) = *static_cast<const T *>(v); }
-    public:
-        json_element() { static __initializer _init; }
+    template<typename T>
+    struct _alloc_counter
+    {
+#if __cplusplus >= 201103L
+        static std::atomic<size_t> count;
+        static std::atomic<size_t> bytes;
+#else
+        static size_t count;
+        static size_t bytes;
+#endif
     };
 
-    template<typename C, typename T>
-    _member_info json_element<C, T>::_meminfo;
+#if __cplusplus >= 201103L
+    template<typename T>
+    std::atomic<size_t> _alloc_counter<T>::count(0);
 
-    template<typename S>
-    class object
+    template<typename T>
+    std::atomic<size_t> _alloc_counter<T>::bytes(0);
+#else
+    template<typename T>
+    size_t _alloc_counter<T>::count = 0;
+
+    template<typename T>
+    size_t _alloc_counter<T>::bytes = 0;
+#endif
+
+    /* call from a replaced operator new to have allocations show up in stats */
+    inline void count_allocation(const size_t bytes)
     {
-    public:
-        typedef S self_type;
-        static _pos_list _pos;
+        ++_alloc_counter<bool>::count;
+        _alloc_counter<bool>::bytes += bytes;
+    }
 
-        static inline void _register(_member_info *mi, const size_t s, const _json_values::type type)
+    namespace _stats_funcs
+    {
+        inline double now()
         {
-            mi->pos = s;
-            mi->type = type;
-            _pos.push_back(mi);
+#if __cplusplus >= 201103L
+            return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+            return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
         }
-    };
 
-    template<typename T>
-    _pos_list object<T>::_pos;
+        /* adds the time between construction and destruction to a phase */
+        class timer
+        {
+            double &phase;
+            const double started;
+        public:
+            explicit timer(double &phase) : phase(phase), started(now()) { }
+            ~timer() { phase += now() - started; }
+        };
+
+        /* adds the allocations counted between construction and destruction */
+        class allocations
+        {
+            stats &s;
+            const size_t count;
+            const size_t bytes;
+        public:
+            explicit allocations(stats &s) : s(s), count(_alloc_counter<bool>::count), bytes(_alloc_counter<bool>::bytes) { }
+            ~allocations()
+            {
+                s.allocations += _alloc_counter<bool>::count - count;
+                s.allocated_bytes += _alloc_counter<bool>::bytes - bytes;
+            }
+        };
+
+        inline void count_members(stats &s, const void *p, const _pos_list *list);
+
+        inline void count_value(stats &s, const void *p, const _member_info *info)
+        {
+            ++s.values;
+            if(info->type == _json_values::object_type)
+            {
+                ++s.objects[info->list->type_name];
+                count_members(s, p, info->list);
+            }
+            else if(info->type == _json_values::array_type)
+            {
+                const size_t n = info->size(p);
+                const _member_info *elem = info->elem;
+                if(elem->type != _json_values::object_type)
+                {
+                    for(size_t i = 0; i < n; ++i)
+                        count_value(s, info->at(p, i), elem);
+                    return;
+                }
+                // one lookup per array instead of per element
+                if(n)
+                    s.objects[elem->list->type_name] += n;
+                s.values += n;
+                for(size_t i = 0; i < n; ++i)
+                    count_members(s, info->at(p, i), elem->list);
+            }
+        }
+
+        inline void count_members(stats &s, const void *p, const _pos_list *list)
+        {
+            for(const _member_info *mi = list->begin(); mi != list->end(); ++mi)
+                count_value(s, static_cast<const char *>(p) + mi->pos, mi);
+        }
+
+        inline void count_nodes(stats &s, const picojson::value &v)
+        {
+            ++s.dom_nodes;
+            if(v.is<picojson::array>())
+            {
+                const picojson::array &a = v.get<picojson::array>();
+                for(picojson::array::const_iterator it = a.begin(); it != a.end(); ++it)
+                    count_nodes(s, *it);
+            }
+            else if(v.is<picojson::object>())
+            {
+                const picojson::object &o = v.get<picojson::object>();
+                for(picojson::object::const_iterator it = o.begin(); it != o.end(); ++it)
+                    count_nodes(s, it->second);
+            }
+        }
+    }
+#endif
+
+    namespace _parser_funcs
+    {
+        /* empties a value for an object read again in place. strings and vectors keep their capacity,
+           and the members of a nested object are emptied one by one */
+        template<typename T>
+        inline void reset_value(T &v, typename _type_checker::_enable<!_type_checker::_has_self_type<T>::value>::type* = 0)
+        {
+            v = T();
+        }
+
+        template<typename T>
+        inline void reset_value(T &v, typename _type_checker::_enable<_type_checker::_has_self_type<T>::value>::type* = 0)
+        {
+            const _pos_list *list = _members<T>::get();
+            for(const _member_info *mi = list->begin(); mi != list->end(); ++mi)
+                mi->reset(reinterpret_cast<char *>(&v) + mi->pos);
+        }
+
+        inline void reset_value(std::string &v) { v.clear(); }
+
+        template<typename T, typename A>
+        inline void reset_value(std::vector<T, A> &v) { v.clear(); }
+
+        /* number conversions. integers are range checked instead of wrapping around */
+        template<typename T>
+        inline bool to_number(
+            T &out, const double d,
+            typename _type_checker::_enable<std::numeric_limits<T>::is_integer>::type* = 0
+        )
+        {
+            if(!(d >= static_cast<double>(std::numeric_limits<T>::min()) &&
+                 d < static_cast<double>(std::numeric_limits<T>::max()) + 1.0))
+                return false;
+            out = static_cast<T>(d);
+            return true;
+        }
+
+        template<typename T>
+        inline bool to_number(
+            T &out, const double d,
+            typename _type_checker::_enable<!std::numeric_limits<T>::is_integer>::type* = 0
+        )
+        {
+            // infinity from a literal beyond double, or a value beyond a float. values up to half a unit
+            // in the last place above the largest float still round to it
+            if(!(std::fabs(d) <= std::numeric_limits<double>::max()))
+                return false;
+            if(std::numeric_limits<T>::max_exponent < std::numeric_limits<double>::max_exponent &&
+                !(std::fabs(d) < static_cast<double>(std::numeric_limits<T>::max()) +
+                    std::ldexp(1.0, std::numeric_limits<T>::max_exponent - std::numeric_limits<T>::digits - 1)))
+                return false;
+            out = static_cast<T>(d);
+            return true;
+        }
+
+        template<typename T>
+        inline bool to_number(
+            T &out, const bool negative, const uint64_t magnitude,
+            typename _type_checker::_enable<std::numeric_limits<T>::is_integer>::type* = 0
+        )
+        {
+            if(!negative)
+            {
+                if(magnitude > static_cast<uint64_t>(std::numeric_limits<T>::max()))
+                    return false;
+                out = static_cast<T>(magnitude);
+            }
+            else if(!std::numeric_limits<T>::is_signed)
+            {
+                if(magnitude != 0)
+                    return false;
+                out = 0;
+            }
+            else
+            {
+                if(magnitude - 1 > static_cast<uint64_t>(std::numeric_limits<T>::max()) && magnitude != 0)
+                    return false;
+                // written this way so that the minimum value does not overflow
+                out = static_cast<T>(-static_cast<int64_t>(magnitude - 1) - 1);
+            }
+            return true;
+        }
+
+        template<typename T>
+        inline bool to_number(
+            T &out, const bool negative, const uint64_t magnitude,
+            typename _type_checker::_enable<!std::numeric_limits<T>::is_integer>::type* = 0
+        )
+        {
+            const double d = static_cast<double>(magnitude);
+            out = static_cast<T>(negative ? -d : d);
+            return true;
+        }
+
+        /* mapping from picojson::value. every value is checked with is<> first, since get<> only asserts */
+        inline bool set_error(error_info *err, const error_info::code_type code)
+        {
+            if(err)
+                err->code = code;
+            return false;
+        }
+
+        inline bool element_error(error_info *err, const size_t index, const error_info::code_type code)
+        {
+            if(err)
+                err->_prepend(index);
+            return set_error(err, code);
+        }
+
+        inline bool map_object(void *result, const _pos_list *list, picojson::object &obj, error_info *err);
+
+        inline bool map_value(void *o, const _member_info *info, picojson::value &value, error_info *err)
+        {
+            switch(info->type)
+            {
+                case _json_values::null_type:
+                    if(!value.is<picojson::null>())
+                        break;
+                    info->s(o, 0);
+                    return true;
+                case _json_values::boolean_type:
+                    if(!value.is<bool>())
+                        break;
+                    {
+                        const bool b = value.get<bool>();
+                        info->s(o, &b);
+                    }
+                    return true;
+                case _json_values::int_type:
+                case _json_values::double_type:
+                    if(!value.is<double>())
+                        break;
+                    {
+                        const double d = value.get<double>();
+                        if(!info->s(o, &d))
+                            return set_error(err, error_info::out_of_range);
+                    }
+                    return true;
+                case _json_values::string_type:
+                    if(!value.is<std::string>())
+                        break;
+                    {
+                        const std::string &s = value.get<std::string>();
+                        if(info->ref)
+                        {
+                            // refers to the string inside value
+                            const str_ref r(s);
+                            info->s(o, &r);
+                        }
+                        else
+                            info->s(o, &s);
+                    }
+                    return true;
+                case _json_values::array_type:
+                    if(!value.is<picojson::array>())
+                        break;
+                    return info->ctor(o, value.get<picojson::array>(), err);
+                case _json_values::object_type:
+                    if(!value.is<picojson::object>())
+                        break;
+                    return map_object(o, info->list, value.get<picojson::object>(), err);
+                case _json_values::error_type:
+                    break;
+            }
+            return set_error(err, error_info::type_mismatch);
+        }
+
+        /* called when an object closes. pointers may be omitted and members ignored by proj are not read,
+           so both are emptied in case result is being read again in place. any other member which did not
+           appear is reported */
+        inline bool finish_object(void *result, const _pos_list *list, const _seen_members &seen,
+            const projection *proj, error_info *err)
+        {
+            if(seen.found == list->count)
+                return true;
+            for(const _member_info *info = list->begin(); info != list->end(); ++info)
+            {
+                if(seen.has(info - list->begin()))
+                    continue;
+                if(info->type != _json_values::null_type && !(proj && proj->ignores(info)))
+                {
+                    if(err)
+                        err->_prepend(info->name, info->name_len);
+                    return set_error(err, error_info::missing_member);
+                }
+                info->reset(static_cast<char *>(result) + info->pos);
+            }
+            return true;
+        }
+
+        inline bool map_object(void *result, const _pos_list *list, picojson::object &obj, error_info *err)
+        {
+            _seen_members seen;
+            seen.clear(list->count);
+            for(picojson::object::iterator it = obj.begin(); it != obj.end(); ++it)
+            {
+                const _member_info *info = list->find(it->first.data(), it->first.size());
+                if(!info)
+                    continue;
+                if(!map_value(static_cast<char *>(result) + info->pos, info, it->second, err))
+                {
+                    if(err)
+                        err->_prepend(it->first.data(), it->first.size());
+                    return false;
+                }
+                seen.add(info - list->begin());
+            }
+            return finish_object(result, list, seen, 0, err);
+        }
+
+        template<typename T>
+        inline bool map_object(T &result, picojson::object &obj, error_info *err)
+        {
+            return map_object(&result, _members<T>::get(), obj, err);
+        }
+
+        /* functions to assign value to vector. the vector is sized once to the array, so that elements left from
+           a previous parse are overwritten in place and the rest are dropped */
+        template<typename T>
+        inline bool assign(
+            void *v,
+            picojson::array &list,
+            error_info *err,
+            typename _type_checker::_enable<
+                (!std::numeric_limits<T>::is_integer || _type_checker::_is_same<T, bool>::value) &&
+                !std::numeric_limits<T>::is_iec559 &&
+                !_type_checker::_has_self_type<T>::value &&
+                !_type_checker::_is_vector<T>::value &&
+                !_type_checker::_is_string_ref<T>::value
+            >::type* = 0)
+        {
+            std::vector<T> &vec = *static_cast<std::vector<T> *>(v);
+            vec.resize(list.size());
+            for(size_t i = 0; i < list.size(); ++i)
+            {
+                if(!list[i].is<T>())
+                    return element_error(err, i, error_info::type_mismatch);
+                vec[i] = list[i].get<T>();
+            }
+            return true;
+        }
+
+        /* views refer to the strings inside list */
+        template<typename T>
+        inline bool assign(
+            void *v,
+            picojson::array &list,
+            error_info *err,
+            typename _type_checker::_enable<_type_checker::_is_string_ref<T>::value>::type* = 0
+        )
+        {
+            std::vector<T> &vec = *static_cast<std::vector<T> *>(v);
+            vec.resize(list.size());
+            for(size_t i = 0; i < list.size(); ++i)
+            {
+                if(!list[i].is<std::string>())
+                    return element_error(err, i, error_info::type_mismatch);
+                const std::string &s = list[i].get<std::string>();
+                vec[i] = T(s.data(), s.size());
+            }
+            return true;
+        }
+
+        template<typename T>
+        inline bool assign(
+            void *v,
+            picojson::array &list,
+            error_info *err,
+            typename _type_checker::_enable<_type_checker::_has_self_type<T>::value>::type* = 0
+        )
+        {
+            std::vector<T> &vec = *static_cast<std::vector<T> *>(v);
+            vec.resize(list.size());
+            for(size_t i = 0; i < list.size(); ++i)
+            {
+                if(!list[i].is<picojson::object>())
+                    return element_error(err, i, error_info::type_mismatch);
+                if(!map_object(vec[i], list[i].get<picojson::object>(), err))
+                {
+                    if(err)
+                        err->_prepend(i);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<typename T>
+        inline bool assign(
+            void *v,
+            picojson::array &list,
+            error_info *err,
+            typename _type_checker::_enable<
+                (std::numeric_limits<T>::is_integer && !_type_checker::_is_same<T, bool>::value) ||
+                std::numeric_limits<T>::is_iec559
+            >::type* = 0
+        )
+        {
+            std::vector<T> &vec = *static_cast<std::vector<T> *>(v);
+            vec.resize(list.size());
+            for(size_t i = 0; i < list.size(); ++i)
+            {
+                if(!list[i].is<double>())
+                    return element_error(err, i, error_info::type_mismatch);
+                T n;
+                if(!to_number(n, list[i].get<double>()))
+                    return element_error(err, i, error_info::out_of_range);
+                vec[i] = n;
+            }
+            return true;
+        }
+
+        template<typename T>
+        inline bool assign(
+            void *v,
+            picojson::array &list,
+            error_info *err,
+            typename _type_checker::_enable<_type_checker::_is_vector<T>::value>::type* = 0
+        )
+        {
+            std::vector<T> &vec = *static_cast<std::vector<T> *>(v);
+            vec.resize(list.size());
+            for(size_t i = 0; i < list.size(); ++i)
+            {
+                if(!list[i].is<picojson::array>())
+                    return element_error(err, i, error_info::type_mismatch);
+                if(!assign<typename T::value_type>(&vec[i], list[i].get<picojson::array>(), err))
+                {
+                    if(err)
+                        err->_prepend(i);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<typename T>
+        inline bool assign_bridge(void *v, picojson::array &list, error_info *err) { return assign<T>(v, list, err); }
+
+        /* the following functions only look at the structure of the text. they are used to find
+           boundaries before the parser runs, which then validates the contents */
+
+        /* p points just after the opening quote. returns the position after the closing quote, or 0 */
+        inline const char *skip_string(const char *p, const char *end)
+        {
+            for(;;)
+            {
+                p = picojson::_scanners<bool>::scan_string(p, end);
+                if(p == end)
+                    return 0;
+                if(*p == '"')
+                    return p + 1;
+                if(*p == '\\')
+                {
+                    if(end - p < 2)
+                        return 0;
+                    p += 2;
+                }
+                else
+                    ++p;    // control characters are rejected later by the parser
+            }
+        }
+
+        /* p points at the first character of a value. returns the position after it, or 0 */
+        inline const char *skip_value(const char *p, const char *end)
+        {
+            if(p == end)
+                return 0;
+            switch(*p)
+            {
+                case '"':
+                    return skip_string(p + 1, end);
+                case '[':
+                case '{':
+                    break;
+                default:
+                    // literals and numbers
+                    while(p != end && *p != ',' && *p != '}' && *p != ']' && !picojson::_is_ws(*p))
+                        ++p;
+                    return p;
+            }
+
+            size_t depth = 0;
+            while(p != end)
+            {
+                switch(*p++)
+                {
+                    case '"':
+                        if(!(p = skip_string(p, end)))
+                            return 0;
+                        break;
+                    case '[':
+                    case '{':
+                        ++depth;
+                        break;
+                    case ']':
+                    case '}':
+                        if(--depth == 0)
+                            return p;
+                        break;
+                }
+            }
+            return 0;
+        }
+
+        /* records where the value of each member of list starts and ends in the object at p. spans has two
+           entries per member and is left untouched for absent members. returns false on broken structure */
+        inline bool index_object(const char *p, const char *end, const _pos_list *list, const char **spans)
+        {
+            picojson::_scan_func ws = picojson::_scanners<bool>::skip_ws;
+            std::string key;
+
+            p = ws(p, end);
+            if(p == end || *p != '{')
+                return false;
+            p = ws(p + 1, end);
+            if(p != end && *p == '}')
+                return ws(p + 1, end) == end;
+
+            for(;;)
+            {
+                if(p == end || *p != '"')
+                    return false;
+                // keys are checked in full, control characters and escapes included
+                const char *k = p + 1;
+                p = k;
+                if(!picojson::_skip_string(p, end))
+                    return false;
+
+                const _member_info *mi;
+                if(memchr(k, '\\', p - 1 - k))
+                {
+                    key.clear();
+                    picojson::input<const char *> in(k, end);
+                    if(!picojson::_parse_string(key, in))
+                        return false;
+                    mi = list->find(key.data(), key.size());
+                }
+                else
+                    mi = list->find(k, p - 1 - k);
+
+                p = ws(p, end);
+                if(p == end || *p != ':')
+                    return false;
+                const char *v = ws(p + 1, end);
+                if(!mi)
+                {
+                    // never decoded, so checked here like the direct parser skips them
+                    p = v;
+                    if(!picojson::_skip(p, end))
+                        return false;
+                }
+                else if(!(p = skip_value(v, end)))
+                    return false;
+                if(mi)
+                {
+                    // a repeated key replaces the value, which is then never decoded. like the direct parser,
+                    // the replaced one has to be valid JSON all the same
+                    const size_t i = mi - list->begin();
+                    const char *q = spans[i * 2];
+                    if(q && (!picojson::_skip(q, spans[i * 2 + 1]) || ws(q, spans[i * 2 + 1]) != spans[i * 2 + 1]))
+                        return false;
+                    spans[i * 2] = v;
+                    spans[i * 2 + 1] = p;
+                }
+
+                p = ws(p, end);
+                if(p == end)
+                    return false;
+                if(*p == '}')
+                    return ws(p + 1, end) == end;
+                if(*p != ',')
+                    return false;
+                p = ws(p + 1, end);
+            }
+        }
+
+        /* finds where the elements of an array start without parsing them. p points just after the opening bracket.
+           returns the closing bracket, or 0 when the array is not terminated before end. starts may be 0 */
+        inline const char *split_array(const char *p, const char *end, std::vector<const char *> *starts)
+        {
+            size_t depth = 0;
+            if(starts)
+                starts->push_back(p);
+            while(p != end)
+            {
+                switch(*p++)
+                {
+                    case '"':
+                        if(!(p = skip_string(p, end)))
+                            return 0;
+                        break;
+                    case '[':
+                    case '{':
+                        ++depth;
+                        break;
+                    case ']':
+                    case '}':
+                        if(depth == 0)
+                            return p - 1;
+                        --depth;
+                        break;
+                    case ',':
+                        if(depth == 0 && starts)
+                            starts->push_back(p);
+                        break;
+                }
+            }
+            return 0;
+        }
+
+        /* p points just after the opening bracket */
+        inline bool empty_array(const char *p, const char *end)
+        {
+            p = picojson::_scanners<bool>::skip_ws(p, end);
+            return p != end && *p == ']';
+        }
+
+        /* values nobody reads are only validated */
+        inline bool skip(picojson::input<const char *> &in)
+        {
+            const char *p = in.cur();
+            const bool ok = picojson::_skip(p, in.end());
+            in.seek(p);
+            return ok;
+        }
+
+        template<typename Iter>
+        inline bool skip(picojson::input<Iter> &in)
+        {
+            picojson::null_parse_context ctx;
+            return picojson::_parse(ctx, in);
+        }
+
+        /* picojson parse context which stores values directly into the members */
+        class mapping_context
+        {
+        private:
+            void *out;
+            const _member_info *info;
+            unsigned int threads;
+            _string_pool *pool;
+            const projection *proj;
+            size_t items, reusable;
+            bool bit;
+            _seen_members seen;
+
+            enum { parallel_threshold = 1048576 };
+
+            /* elements already in the vector are overwritten so that their buffers are reused.
+               an element of std::vector<bool> is parsed into bit and stored by parse_item */
+            inline void *next_item()
+            {
+                if(info->store_bit)
+                {
+                    ++items;
+                    return &bit;
+                }
+                if(items < reusable)
+                    return const_cast<void *>(info->at(out, items++));
+                ++items;
+                return info->push(out);
+            }
+
+#if __cplusplus >= 201103L
+            /* maps the elements of an array found by split_array on several threads */
+            bool parse_array_parallel(picojson::input<const char *> &in)
+            {
+                std::vector<const char *> starts;
+                const char *close = split_array(in.cur(), in.end(), &starts);
+                if(!close)
+                {
+                    // let the sequential parser report the error
+                    mapping_context ctx(next_item(), info->elem, 1, pool, proj);
+                    return picojson::_parse(ctx, in);
+                }
+
+                const size_t n = starts.size();
+                info->resize(out, n);
+                items = reusable = n;
+
+                const size_t chunks = n > threads * 8 ? threads * 8 : 1;
+                std::vector<const char *> failed(chunks, static_cast<const char *>(0));
+                _parallel::run(chunks, threads, [&](const size_t c)
+                {
+                    for(size_t i = c * n / chunks, last = (c + 1) * n / chunks; i != last; ++i)
+                    {
+                        picojson::input<const char *> elem(starts[i], in.end());
+                        mapping_context ctx(const_cast<void *>(info->at(out, i)), info->elem, 1, pool, proj);
+                        const bool more = i + 1 != n;
+                        if(!picojson::_parse(ctx, elem) || !elem.expect(more ? ',' : ']')
+                            || elem.cur() != (more ? starts[i + 1] : close + 1))
+                        {
+                            failed[c] = elem.cur();
+                            return;
+                        }
+                    }
+                });
+
+                for(size_t c = 0; c < chunks; ++c)
+                {
+                    if(failed[c])
+                    {
+                        in.seek(failed[c]);
+                        return false;
+                    }
+                }
+                in.seek(close);
+                return true;
+            }
+#endif
+        public:
+            mapping_context(void *out, const _member_info *info, const unsigned int threads = 1, _string_pool *pool = 0,
+                const projection *proj = 0)
+                : out(out), info(info), threads(threads), pool(pool), proj(proj), items(0), reusable(0), bit(false) { }
+
+            bool set_null()
+            {
+                if(info->type != _json_values::null_type)
+                    return false;
+                info->s(out, 0);
+                return true;
+            }
+
+            bool set_bool(bool b)
+            {
+                if(info->type != _json_values::boolean_type)
+                    return false;
+                info->s(out, &b);
+                return true;
+            }
+
+            bool set_number(double f)
+            {
+                switch(info->type)
+                {
+                    case _json_values::int_type:
+                    case _json_values::double_type:
+                        return info->s(out, &f);
+                    default:
+                        return false;
+                }
+            }
+
+            bool set_integer(bool negative, uint64_t magnitude)
+            {
+                switch(info->type)
+                {
+                    case _json_values::int_type:
+                    case _json_values::double_type:
+                        return info->si(out, negative, magnitude);
+                    default:
+                        return false;
+                }
+            }
+
+            template<typename Iter>
+            bool parse_string(picojson::input<Iter> &in)
+            {
+                if(info->type != _json_values::string_type)
+                    return false;
+                if(info->ref)
+                    return parse_string_ref(in);
+                std::string &str = *static_cast<std::string *>(out);
+                str.clear();
+                return picojson::_parse_string(str, in);
+            }
+
+            /* strings without escapes refer to the input directly. views are only handed out
+               while a document keeps the input alive */
+            bool parse_string_ref(picojson::input<const char *> &in)
+            {
+                if(!pool)
+                    return false;
+                const char *first = in.cur();
+                const char *p = picojson::_scanners<bool>::scan_string(first, in.end());
+                if(p == in.end() || *p != '"')
+                    return store_string(in);
+
+                in.seek(p + 1);
+                const str_ref r(first, p - first);
+                return info->s(out, &r);
+            }
+
+            template<typename Iter>
+            inline bool parse_string_ref(picojson::input<Iter> &in) { return store_string(in); }
+
+            template<typename Iter>
+            bool store_string(picojson::input<Iter> &in)
+            {
+                std::string str;
+                if(!pool || !picojson::_parse_string(str, in))
+                    return false;
+                const str_ref r = pool->store(str);
+                return info->s(out, &r);
+            }
+
+            bool parse_array_start()
+            {
+                if(info->type != _json_values::array_type)
+                    return false;
+                items = 0;
+                reusable = info->size(out);
+                return true;
+            }
+
+            template<typename Iter>
+            bool parse_item(picojson::input<Iter> &in)
+            {
+                mapping_context ctx(next_item(), info->elem, threads, pool, proj);
+                if(!picojson::_parse(ctx, in))
+                    return false;
+                if(info->store_bit)
+                    info->store_bit(out, items - 1, bit);
+                return true;
+            }
+
+            template<typename Iter>
+            bool parse_array_item(picojson::input<Iter> &in, size_t) { return parse_item(in); }
+
+#if __cplusplus >= 201103L
+            /* only arrays that have elements and do not close within the threshold are split. the bits of
+               a std::vector<bool> share words, so they are never written from several threads */
+            bool parse_array_item(picojson::input<const char *> &in, const size_t idx)
+            {
+                if(threads > 1 && idx == 0 && !info->store_bit && static_cast<size_t>(in.end() - in.cur()) >= parallel_threshold
+                    && !empty_array(in.cur(), in.end()) && !split_array(in.cur(), in.cur() + parallel_threshold, 0))
+                    return parse_array_parallel(in);
+                return parse_item(in);
+            }
+#endif
+
+            /* drops the elements left over from the previous contents */
+            bool parse_array_stop(size_t)
+            {
+                if(items < reusable)
+                    info->resize(out, items);
+                return true;
+            }
+
+            bool parse_object_start()
+            {
+                if(info->type != _json_values::object_type)
+                    return false;
+                seen.clear(info->list->count);
+                return true;
+            }
+
+            template<typename Iter>
+            bool parse_object_item(picojson::input<Iter> &in, const std::string &key)
+            {
+                const _member_info *mi = info->list->find(key.data(), key.size());
+                if(!mi || (proj && proj->ignores(mi)))
+                    return skip(in);
+                mapping_context ctx(static_cast<char *>(out) + mi->pos, mi, threads, pool, proj);
+                if(!picojson::_parse(ctx, in))
+                    return false;
+                seen.add(mi - info->list->begin());
+                return true;
+            }
+
+            bool parse_object_stop() { return finish_object(out, info->list, seen, proj, 0); }
+        private:
+            mapping_context(const mapping_context &);
+            mapping_context &operator=(const mapping_context &);
+        };
+
+        /* rejects every value. when err is given, the reason is recorded there, so that the caller
+           can tell a syntax error from a value which does not fit */
+        class typed_base
+        {
+        protected:
+            error_info *err;
+
+            inline bool mismatch() { return set_error(err, error_info::type_mismatch); }
+            inline bool in_range(const bool ok) { return ok || set_error(err, error_info::out_of_range); }
+        public:
+            typed_base(error_info *err) : err(err) { }
+
+            bool set_null() { return mismatch(); }
+            bool set_bool(bool) { return mismatch(); }
+            bool set_number(double) { return mismatch(); }
+            bool set_integer(bool, uint64_t) { return mismatch(); }
+            template<typename Iter> bool parse_string(picojson::input<Iter> &) { return mismatch(); }
+            bool parse_array_start() { return mismatch(); }
+            template<typename Iter> bool parse_array_item(picojson::input<Iter> &, size_t) { return false; }
+            bool parse_array_stop(size_t) { return false; }
+            bool parse_object_start() { return mismatch(); }
+            template<typename Iter> bool parse_object_item(picojson::input<Iter> &, const std::string &) { return false; }
+            bool parse_object_stop() { return false; }
+        };
+
+        /* parse context generated for each destination type at compile time. values are parsed straight
+           into T, and members are reached through their _field, so there is no indirect call nor temporary
+           per value. types that cannot be mapped reject every value */
+        template<typename T, _json_values::type K = _type_checker::get_type<T>::value>
+        class typed_context : public typed_base
+        {
+        public:
+            typed_context(T &, _string_pool *, const projection *, error_info *err) : typed_base(err) { }
+        };
+
+        template<typename T>
+        class typed_context<T, _json_values::null_type> : public typed_base
+        {
+        private:
+            T &out;
+        public:
+            typed_context(T &out, _string_pool *, const projection *, error_info *err) : typed_base(err), out(out) { }
+
+            bool set_null()
+            {
+                out = T();
+                return true;
+            }
+        };
+
+        template<typename T>
+        class typed_context<T, _json_values::boolean_type> : public typed_base
+        {
+        private:
+            T &out;
+        public:
+            typed_context(T &out, _string_pool *, const projection *, error_info *err) : typed_base(err), out(out) { }
+
+            bool set_bool(bool b)
+            {
+                out = b;
+                return true;
+            }
+        };
+
+        template<typename T>
+        class typed_number : public typed_base
+        {
+        private:
+            T &out;
+        public:
+            typed_number(T &out, error_info *err) : typed_base(err), out(out) { }
+
+            bool set_number(double f) { return in_range(to_number(out, f)); }
+            bool set_integer(bool negative, uint64_t magnitude) { return in_range(to_number(out, negative, magnitude)); }
+        };
+
+        template<typename T>
+        class typed_context<T, _json_values::int_type> : public typed_number<T>
+        {
+        public:
+            typed_context(T &out, _string_pool *, const projection *, error_info *err) : typed_number<T>(out, err) { }
+        };
+
+        template<typename T>
+        class typed_context<T, _json_values::double_type> : public typed_number<T>
+        {
+        public:
+            typed_context(T &out, _string_pool *, const projection *, error_info *err) : typed_number<T>(out, err) { }
+        };
+
+        /* views. same rules as mapping_context::parse_string_ref */
+        template<typename T>
+        class typed_context<T, _json_values::string_type> : public typed_base
+        {
+        private:
+            T &out;
+            _string_pool *pool;
+
+            template<typename Iter>
+            bool store_string(picojson::input<Iter> &in)
+            {
+                std::string str;
+                if(!pool)
+                    return mismatch();
+                if(!picojson::_parse_string(str, in))
+                    return false;
+                const str_ref r = pool->store(str);
+                out = T(r.data(), r.size());
+                return true;
+            }
+        public:
+            typed_context(T &out, _string_pool *pool, const projection *, error_info *err)
+                : typed_base(err), out(out), pool(pool) { }
+
+            bool parse_string(picojson::input<const char *> &in)
+            {
+                if(!pool)
+                    return mismatch();
+                const char *first = in.cur();
+                const char *p = picojson::_scanners<bool>::scan_string(first, in.end());
+                if(p == in.end() || *p != '"')
+                    return store_string(in);
+
+                in.seek(p + 1);
+                out = T(first, p - first);
+                return true;
+            }
+
+            template<typename Iter>
+            inline bool parse_string(picojson::input<Iter> &in) { return store_string(in); }
+        };
+
+        template<>
+        class typed_context<std::string, _json_values::string_type> : public typed_base
+        {
+        private:
+            std::string &out;
+        public:
+            typed_context(std::string &out, _string_pool *, const projection *, error_info *err)
+                : typed_base(err), out(out) { }
+
+            template<typename Iter>
+            bool parse_string(picojson::input<Iter> &in)
+            {
+                out.clear();
+                return picojson::_parse_string(out, in);
+            }
+        };
+
+        template<typename T, _json_values::type K = _type_checker::get_type<T>::value>
+        struct typed_element;
+
+        /* elements already in the vector are overwritten so that their buffers are reused */
+        template<typename T>
+        class typed_context<T, _json_values::array_type> : public typed_base
+        {
+        private:
+            typedef typed_element<typename T::value_type> element;
+
+            T &out;
+            _string_pool *pool;
+            const projection *proj;
+            const _pos_list *elements;
+            size_t items;
+        public:
+            typed_context(T &out, _string_pool *pool, const projection *proj, error_info *err)
+                : typed_base(err), out(out), pool(pool), proj(proj), elements(element::table()), items(0) { }
+
+            bool parse_array_start()
+            {
+                items = 0;
+                return true;
+            }
+
+            template<typename Iter>
+            bool parse_array_item(picojson::input<Iter> &in, size_t)
+            {
+                if(items == out.size())
+                    out.push_back(typename T::value_type());
+                if(element::parse(out[items++], in, pool, proj, err, elements))
+                    return true;
+                if(err)
+                    err->_prepend(items - 1);
+                return false;
+            }
+
+            bool parse_array_stop(size_t)
+            {
+                if(items < out.size())
+                    out.resize(items);
+                return true;
+            }
+        };
+
+        /* std::vector<bool> has no references to its elements, so each one is parsed into a bool and stored */
+        template<typename A>
+        class typed_context<std::vector<bool, A>, _json_values::array_type> : public typed_base
+        {
+        private:
+            std::vector<bool, A> &out;
+            size_t items;
+        public:
+            typed_context(std::vector<bool, A> &out, _string_pool *, const projection *, error_info *err)
+                : typed_base(err), out(out), items(0) { }
+
+            bool parse_array_start()
+            {
+                items = 0;
+                return true;
+            }
+
+            template<typename Iter>
+            bool parse_array_item(picojson::input<Iter> &in, size_t)
+            {
+                bool b = false;
+                typed_context<bool> ctx(b, 0, 0, err);
+                if(!picojson::_parse(ctx, in))
+                {
+                    if(err)
+                        err->_prepend(items);
+                    return false;
+                }
+                if(items == out.size())
+                    out.push_back(b);
+                else
+                    out[items] = b;
+                ++items;
+                return true;
+            }
+
+            bool parse_array_stop(size_t)
+            {
+                if(items < out.size())
+                    out.resize(items);
+                return true;
+            }
+        };
+
+        /* parses the value of one member, called through member_dispatch */
+        template<typename Iter>
+        struct field_parser
+        {
+            picojson::input<Iter> &in;
+            _string_pool *pool;
+            const projection *proj;
+            error_info *err;
+
+            field_parser(picojson::input<Iter> &in, _string_pool *pool, const projection *proj, error_info *err)
+                : in(in), pool(pool), proj(proj), err(err) { }
+
+            template<typename F>
+            inline bool operator()(F *, typename F::owner_type &out)
+            {
+                typed_context<typename F::value_type> ctx(F::get(out), pool, proj, err);
+                return picojson::_parse(ctx, in);
+            }
+        };
+
+        /* calls visit(field, out) for member i of C by binary search over [L, H), so that the compiler sees
+           every member as a direct call. out is a C or a const C */
+        template<typename C, int L, int H, bool Leaf = (H - L <= 1)>
+        struct member_dispatch
+        {
+            template<typename O, typename V>
+            inline static bool apply(O &out, const int i, V &visit)
+            {
+                if(i < (L + H) / 2)
+                    return member_dispatch<C, L, (L + H) / 2>::apply(out, i, visit);
+                return member_dispatch<C, (L + H) / 2, H>::apply(out, i, visit);
+            }
+        };
+
+        template<typename C, int L, int H>
+        struct member_dispatch<C, L, H, true>
+        {
+            template<typename O, typename V>
+            inline static bool apply(O &out, const int, V &visit)
+            {
+                return visit(_describe<C>::type::_member(static_cast<_type_checker::_index<L> *>(0)), out);
+            }
+        };
+
+        template<typename C, int L>
+        struct member_dispatch<C, L, L, true>
+        {
+            template<typename O, typename V>
+            inline static bool apply(O &, const int, V &) { return false; }
+        };
+
+        /* keys are still looked up by the perfect hash. members ignored by proj are skipped */
+        template<typename T>
+        class typed_context<T, _json_values::object_type> : public typed_base
+        {
+        private:
+            T &out;
+            _string_pool *pool;
+            const projection *proj;
+            const _pos_list *list;
+            _seen_members seen;
+        public:
+            typed_context(T &out, _string_pool *pool, const projection *proj, error_info *err)
+                : typed_base(err), out(out), pool(pool), proj(proj), list(_members<T>::get()) { }
+            typed_context(T &out, _string_pool *pool, const projection *proj, error_info *err, const _pos_list *list)
+                : typed_base(err), out(out), pool(pool), proj(proj), list(list) { }
+
+            bool parse_object_start()
+            {
+                seen.clear(list->count);
+                return true;
+            }
+
+            template<typename Iter>
+            bool parse_object_item(picojson::input<Iter> &in, const std::string &key)
+            {
+                const _member_info *mi = list->find(key.data(), key.size());
+                if(!mi || (proj && proj->ignores(mi)))
+                    return skip(in);
+                field_parser<Iter> visit(in, pool, proj, err);
+                const int i = static_cast<int>(mi - list->begin());
+                if(member_dispatch<T, 0, _members<T>::count>::apply(out, i, visit))
+                {
+                    seen.add(i);
+                    return true;
+                }
+                if(err)
+                    err->_prepend(key.data(), key.size());
+                return false;
+            }
+
+            bool parse_object_stop() { return finish_object(&out, list, seen, proj, err); }
+        };
+
+        /* parses an element of an array. the member table of objects is fetched once per array */
+        template<typename T, _json_values::type K>
+        struct typed_element
+        {
+            inline static const _pos_list *table() { return 0; }
+
+            template<typename Iter>
+            inline static bool parse(T &out, picojson::input<Iter> &in, _string_pool *pool, const projection *proj,
+                error_info *err, const _pos_list *)
+            {
+                typed_context<T> ctx(out, pool, proj, err);
+                return picojson::_parse(ctx, in);
+            }
+        };
+
+        template<typename T>
+        struct typed_element<T, _json_values::object_type>
+        {
+            inline static const _pos_list *table() { return _members<T>::get(); }
+
+            template<typename Iter>
+            inline static bool parse(T &out, picojson::input<Iter> &in, _string_pool *pool, const projection *proj,
+                error_info *err, const _pos_list *list)
+            {
+                typed_context<T> ctx(out, pool, proj, err, list);
+                return picojson::_parse(ctx, in);
+            }
+        };
+
+        /* stage 2 of the structural index. values are mapped by walking the offsets of the structural
+           characters, so only scalars and strings are looked at byte by byte. info == 0 validates and skips */
+        class index_mapper
+        {
+        private:
+            const char *base, *end;
+            const uint32_t *cur, *last;     // next structural character
+            const char *pos;                // just after the last consumed token
+            bool escapes;                   // whether the input has a backslash at all
+            _string_pool *pool;
+            const projection *proj;
+            const char *failed;
+            error_info error;               // what failed, in the same terms as the direct parser
+            std::string key;
+
+            index_mapper(const index_mapper &);
+            index_mapper &operator=(const index_mapper &);
+
+            inline const char *next() const { return cur != last ? base + *cur : end; }
+            inline const char *ws(const char *p) const
+            {
+                if(p == end || !picojson::_is_ws(*p))
+                    return p;
+                return picojson::_scanners<bool>::skip_ws(p + 1, end);
+            }
+
+            inline bool fail(const char *p, const error_info::code_type code = error_info::syntax_error)
+            {
+                failed = p;
+                error.code = code;
+                return false;
+            }
+
+            /* consumes the next structural character if it is c and nothing but whitespace precedes it */
+            inline bool expect(const char c)
+            {
+                const char *p = next();
+                if(cur == last || *p != c || ws(pos) != p)
+                    return fail(ws(pos));
+                ++cur;
+                pos = p + 1;
+                return true;
+            }
+
+            inline bool peek(const char c) const { return cur != last && base[*cur] == c && ws(pos) == next(); }
+
+            /* the closing quote of the string opened at p, found from the next structural character.
+               any quote in between would have been indexed as an opening one */
+            const char *close_quote(const char *p) const
+            {
+                const char *q = next();
+                while(q > p + 1 && picojson::_is_ws(q[-1]))
+                    --q;
+                return q > p + 1 && q[-1] == '"' ? q - 1 : 0;
+            }
+
+            bool scalar(void *out, const _member_info *info, const char *p)
+            {
+                const char *q = next();
+                while(q > p && picojson::_is_ws(q[-1]))
+                    --q;
+                const size_t len = q - p;
+                pos = q;
+
+                switch(*p)
+                {
+                    case 'n':
+                        if(len != 4 || memcmp(p, "null", 4) != 0)
+                            return fail(p);
+                        if(!info)
+                            return true;
+                        if(info->type != _json_values::null_type)
+                            return fail(p, error_info::type_mismatch);
+                        info->s(out, 0);
+                        return true;
+                    case 't':
+                    case 'f':
+                        {
+                            const bool b = *p == 't';
+                            if(b ? len != 4 || memcmp(p, "true", 4) != 0 : len != 5 || memcmp(p, "false", 5) != 0)
+                                return fail(p);
+                            if(!info)
+                                return true;
+                            if(info->type != _json_values::boolean_type)
+                                return fail(p, error_info::type_mismatch);
+                            info->s(out, &b);
+                            return true;
+                        }
+                    default:
+                        break;
+                }
+
+                // the span is known, so plain integers are read without picojson's number grammar
+                const bool negative = *p == '-';
+                const char *d = p + negative;
+                uint64_t magnitude = 0;
+                bool integer = d != q && q - d <= 19 && (*d != '0' || q - d == 1);
+                for(const char *c = d; integer && c != q; ++c)
+                {
+                    if(*c < '0' || *c > '9')
+                        integer = false;
+                    else
+                        magnitude = magnitude * 10 + (*c - '0');
+                }
+
+                picojson::_number num;
+                if(integer)
+                {
+                    num.is_integer = true;
+                    num.negative = negative;
+                    num.magnitude = magnitude;
+                    num.value = 0;
+                }
+                else
+                {
+                    picojson::input<const char *> in(p, q);
+                    if(len == 0 || (*p != '-' && (*p < '0' || *p > '9')) || !picojson::_parse_number(num, in) || in.cur() != q)
+                        return fail(p);
+                }
+                if(!info)
+                    return true;
+                if(info->type != _json_values::int_type && info->type != _json_values::double_type)
+                    return fail(p, error_info::type_mismatch);
+                if(!(num.is_integer ? info->si(out, num.negative, num.magnitude) : info->s(out, &num.value)))
+                    return fail(p, error_info::out_of_range);
+                return true;
+            }
+
+            bool string(void *out, const _member_info *info, const char *p)
+            {
+                ++cur;
+                const char *close = close_quote(p);
+                if(!close)
+                    return fail(p);
+                pos = close + 1;
+
+                const char *first = p + 1;
+                const bool escaped = escapes && memchr(first, '\\', close - first) != 0;
+                if(!info)
+                {
+                    if(!escaped)
+                        return true;
+                    picojson::null_parse_context::dummy_str dummy;
+                    picojson::input<const char *> in(first, pos);
+                    return (picojson::_parse_string(dummy, in) && in.cur() == pos) || fail(p);
+                }
+                if(info->type != _json_values::string_type)
+                    return fail(p, error_info::type_mismatch);
+
+                if(info->ref)
+                {
+                    if(!pool)
+                        return fail(p);
+                    str_ref r(first, close - first);
+                    if(escaped)
+                    {
+                        key.clear();
+                        picojson::input<const char *> in(first, pos);
+                        if(!picojson::_parse_string(key, in) || in.cur() != pos)
+                            return fail(p);
+                        r = pool->store(key);
+                    }
+                    return info->s(out, &r);
+                }
+
+                std::string &str = *static_cast<std::string *>(out);
+                if(!escaped)
+                {
+                    str.assign(first, close);
+                    return true;
+                }
+                str.clear();
+                picojson::input<const char *> in(first, pos);
+                return (picojson::_parse_string(str, in) && in.cur() == pos) || fail(p);
+            }
+
+            bool array(void *out, const _member_info *info)
+            {
+                if(info && info->type != _json_values::array_type)
+                    return fail(next(), error_info::type_mismatch);
+                if(!expect('['))
+                    return false;
+                if(!info)
+                {
+                    if(peek(']'))
+                        return expect(']');
+                    do
+                    {
+                        if(!value(0, 0))
+                            return false;
+                    } while(peek(',') && expect(','));
+                    return expect(']');
+                }
+
+                // same as mapping_context, existing elements are overwritten
+                const size_t reusable = info->size(out);
+                size_t items = 0;
+                if(!peek(']'))
+                {
+                    do
+                    {
+                        bool bit;
+                        void *elem = info->store_bit ? &bit
+                            : items < reusable ? const_cast<void *>(info->at(out, items)) : info->push(out);
+                        if(!value(elem, info->elem))
+                        {
+                            error._prepend(items);
+                            return false;
+                        }
+                        if(info->store_bit)
+                            info->store_bit(out, items, bit);
+                        ++items;
+                    } while(peek(',') && expect(','));
+                }
+                if(items < reusable)
+                    info->resize(out, items);
+                return expect(']');
+            }
+
+            bool object(void *out, const _member_info *info)
+            {
+                if(info && info->type != _json_values::object_type)
+                    return fail(next(), error_info::type_mismatch);
+                if(!expect('{'))
+                    return false;
+                _seen_members seen;
+                if(info)
+                    seen.clear(info->list->count);
+                if(peek('}'))
+                    return close_object(out, info, seen);
+                do
+                {
+                    const char *p = ws(pos);
+                    if(cur == last || p != next() || *p != '"')
+                        return fail(p);
+                    ++cur;
+                    const char *close = close_quote(p);
+                    if(!close)
+                        return fail(p);
+                    pos = close + 1;
+
+                    // keys with escapes are decoded even while skipping, since that is what validates them
+                    const bool escaped = escapes && memchr(p + 1, '\\', close - p - 1);
+                    if(escaped)
+                    {
+                        key.clear();
+                        picojson::input<const char *> in(p + 1, pos);
+                        if(!picojson::_parse_string(key, in) || in.cur() != pos)
+                            return fail(p);
+                    }
+                    const _member_info *mi = 0;
+                    if(info)
+                    {
+                        mi = escaped ? info->list->find(key.data(), key.size()) : info->list->find(p + 1, close - p - 1);
+                        if(mi && proj && proj->ignores(mi))
+                            mi = 0;
+                    }
+
+                    if(!expect(':'))
+                        return false;
+                    if(!mi)
+                    {
+                        if(!value(0, 0))
+                            return false;
+                        continue;
+                    }
+                    if(!value(static_cast<char *>(out) + mi->pos, mi))
+                    {
+                        error._prepend(mi->name, mi->name_len);
+                        return false;
+                    }
+                    seen.add(mi - info->list->begin());
+                } while(peek(',') && expect(','));
+                return close_object(out, info, seen);
+            }
+
+            bool close_object(void *out, const _member_info *info, const _seen_members &seen)
+            {
+                const char *p = next();
+                if(!expect('}'))
+                    return false;
+                if(!info || finish_object(out, info->list, seen, proj, &error))
+                    return true;
+                failed = p;
+                return false;
+            }
+        public:
+            index_mapper(const char *str, const size_t len, const std::vector<uint32_t> &index, const bool escapes,
+                _string_pool *pool, const projection *proj = 0)
+                : base(str), end(str + len), cur(index.empty() ? 0 : &index[0]), last(cur + index.size()),
+                  pos(str), escapes(escapes), pool(pool), proj(proj), failed(0) { }
+
+            bool value(void *out, const _member_info *info)
+            {
+                const char *p = ws(pos);
+                if(p == end)
+                    return fail(p);
+                if(p != next())
+                    return scalar(out, info, p);
+                switch(*p)
+                {
+                    case '{':
+                        return object(out, info);
+                    case '[':
+                        return array(out, info);
+                    case '"':
+                        return string(out, info, p);
+                    default:
+                        return fail(p);
+                }
+            }
+
+            /* maps the whole input, which must hold exactly one value */
+            bool run(void *out, const _member_info *info)
+            {
+                if(!value(out, info))
+                    return false;
+                if(cur != last || ws(pos) != end)
+                    return fail(ws(pos));
+                return true;
+            }
+
+            inline const char *error_position() const { return failed; }
+            inline const error_info &last_error() const { return error; }
+        };
+
+        /* runs ctx over str, which must hold exactly one value like the indexed mapper expects.
+           last receives where parsing stopped, and err the message of a failure */
+        template<typename Context>
+        inline bool run(Context &ctx, const char *str, const size_t len, std::string *err, const char *&last)
+        {
+            picojson::input<const char *> in(str, str + len);
+            bool ok = picojson::_parse(ctx, in);
+            if(ok)
+            {
+                in.skip_ws();
+                ok = in.cur() == in.end();
+            }
+            last = in.cur();
+            if(!ok && err)
+                picojson::_syntax_error(*err, in);
+            return ok;
+        }
+
+        /* maps str directly into result. returns false on syntax or type error.
+           a single thread uses the decoder generated for T, with threads > 1 large arrays are mapped
+           in parallel (C++11). str_ref members need a pool. members ignored by proj are skipped.
+           anything but whitespace after the root is a syntax error. err and info may be 0. info is only classified by the single threaded decoder */
+        template<typename T>
+        inline bool parse(T &result, const char *str, const size_t len, std::string *err,
+            const char **end = 0, const unsigned int threads = 1, _string_pool *pool = 0, const projection *proj = 0,
+            error_info *info = 0)
+        {
+            const char *last;
+            bool ok;
+            error_info local;
+            if(threads > 1)
+            {
+                _member_info root = _member_info();
+                root.type = _json_values::object_type;
+                root.list = _members<T>::get();
+
+                mapping_context ctx(&result, &root, threads, pool, proj);
+                ok = run(ctx, str, len, err, last);
+            }
+            else
+            {
+                // the message tells a missing member or a type error from a syntax error
+                if(!info && err)
+                    info = &local;
+                typed_context<T> ctx(result, pool, proj, info);
+                ok = run(ctx, str, len, err, last);
+                if(!ok && err && info->code != error_info::ok)
+                    *err = std::string(info->message()) + ": " + info->path;
+            }
+            if(end)
+                *end = last;
+            if(!ok && info)
+            {
+                info->offset = last - str;
+                if(info->code == error_info::ok)
+                    info->code = error_info::syntax_error;
+            }
+            return ok;
+        }
+
+        /* maps str into result through the structural index. index is scratch space kept by the caller.
+           falls back to the direct parser when stage 1 rejects the input, so error messages stay the same.
+           err may be 0.
+           with NANOJSON_STATS, the time spent on stage 1 is added to index_time */
+        template<typename T>
+        inline bool parse_indexed(T &result, const char *str, const size_t len, std::string *err,
+            std::vector<uint32_t> &index, _string_pool *pool = 0, const projection *proj = 0
+#ifdef NANOJSON_STATS
+            , double *index_time = 0
+#endif
+            )
+        {
+            bool escapes;
+#ifdef NANOJSON_STATS
+            const double started = _stats_funcs::now();
+            const bool built = picojson::_build_structural_index(str, len, index, &escapes);
+            if(index_time)
+                *index_time += _stats_funcs::now() - started;
+            if(!built)
+#else
+            if(!picojson::_build_structural_index(str, len, index, &escapes))
+#endif
+                return parse(result, str, len, err, 0, 1, pool, proj);
+
+            _member_info root = _member_info();
+            root.type = _json_values::object_type;
+            root.list = _members<T>::get();
+
+            index_mapper mapper(str, len, index, escapes, pool, proj);
+            if(mapper.run(&result, &root))
+                return true;
+            if(!err)
+                return false;
+
+            // worded like parse, so that switching to the index does not change the messages
+            const error_info &e = mapper.last_error();
+            if(e.code != error_info::syntax_error)
+            {
+                *err = std::string(e.message()) + ": " + e.path;
+                return false;
+            }
+            const char *p = mapper.error_position();
+            picojson::_syntax_error(*err, 1 + static_cast<int>(std::count(str, p, '\n')), p, str + len);
+            return false;
+        }
+    }
+
+    /* serializes objects into an internal buffer, optionally flushed to a file descriptor */
+    class writer
+    {
+    public:
+        enum mode
+        {
+            compact,
+            pretty
+        };
+    private:
+        std::string buffer;
+        mode fmt;
+        int fd;
+        int depth;
+
+        enum { flush_size = 65536 };
+
+        inline void put(const char c) { buffer.push_back(c); }
+
+        inline void flush_if_full()
+        {
+            if(fd >= 0 && buffer.size() >= flush_size)
+                flush();
+        }
+        inline void put(const char *str, const size_t len) { buffer.append(str, len); }
+
+        void newline()
+        {
+            if(fmt != pretty)
+                return;
+            put('\n');
+            buffer.append(depth * 4, ' ');
+        }
+
+        void write_value(const void *p, const _member_info *info)
+        {
+            switch(info->type)
+            {
+                case _json_values::array_type:
+                    {
+                        const size_t n = info->size(p);
+                        put('[');
+                        if(n == 0)
+                        {
+                            put(']');
+                            break;
+                        }
+                        ++depth;
+                        for(size_t i = 0; i < n; ++i)
+                        {
+                            if(i != 0)
+                                put(',');
+                            newline();
+                            write_value(info->at(p, i), info->elem);
+                            flush_if_full();
+                        }
+                        --depth;
+                        newline();
+                        put(']');
+                    }
+                    break;
+                case _json_values::object_type:
+                    write_object(p, info->list);
+                    break;
+                case _json_values::error_type:
+                    throw __exception("error invalid member type");
+                default:
+                    info->w(*this, p);
+                    break;
+            }
+        }
+
+        void write_object(const void *p, const _pos_list *list)
+        {
+            put('{');
+            if(list->empty())
+            {
+                put('}');
+                return;
+            }
+            ++depth;
+            for(const _member_info *mi = list->begin(); mi != list->end(); ++mi)
+            {
+                if(mi != list->begin())
+                    put(',');
+                newline();
+                put_string(mi->name);
+                put(':');
+                if(fmt == pretty)
+                    put(' ');
+                write_value(static_cast<const char *>(p) + mi->pos, mi);
+                flush_if_full();
+            }
+            --depth;
+            newline();
+            put('}');
+        }
+    public:
+        writer(const mode fmt = compact) : fmt(fmt), fd(-1), depth(0) { }
+#ifdef NANOJSON_POSIX
+        writer(const int fd, const mode fmt = compact) : fmt(fmt), fd(fd), depth(0) { }
+#endif
+        ~writer() { }
+
+        template<typename T>
+        void write(const T &obj)
+        {
+            write_object(&obj, _members<T>::get());
+            if(fmt == pretty)
+                put('\n');
+            flush();
+        }
+
+        /* writes buffered data to the file descriptor, retrying interrupted and partial writes. the buffer keeps its capacity */
+        void flush()
+        {
+#ifdef NANOJSON_POSIX
+            if(fd < 0)
+                return;
+            const char *p = buffer.data();
+            size_t len = buffer.size();
+            while(len > 0)
+            {
+                const ssize_t n = ::write(fd, p, len);
+                if(n < 0 && errno == EINTR)
+                    continue;
+                if(n < 0)
+                    throw __exception("failed to write.");
+                p += n;
+                len -= n;
+            }
+            buffer.clear();
+#endif
+        }
+
+        inline void clear() { buffer.clear(); }
+        inline const char *data() const { return buffer.data(); }
+        inline size_t size() const { return buffer.size(); }
+        inline const std::string &str() const { return buffer; }
+
+        /* primitives used by the member tables */
+        inline void put_null() { put("null", 4); }
+        inline void put_bool(const bool b) { b ? put("true", 4) : put("false", 5); }
+
+        template<typename T>
+        void put_integer(T v)
+        {
+            char buf[std::numeric_limits<T>::digits10 + 3];
+            char *p = buf + sizeof(buf);
+            const bool negative = v < 0;
+            do
+            {
+                const int d = static_cast<int>(v % 10);
+                *--p = static_cast<char>('0' + (negative ? -d : d));
+                v /= 10;
+            } while(v != 0);
+            if(negative)
+                *--p = '-';
+            put(p, buf + sizeof(buf) - p);
+        }
+
+        /* snprintf writes the locale's decimal point, JSON always uses a period */
+        void put_number(char *buf, const int n)
+        {
+            const char point = *localeconv()->decimal_point;
+            if(point != '.')
+            {
+                if(char *p = static_cast<char *>(memchr(buf, point, n)))
+                    *p = '.';
+            }
+            put(buf, n);
+        }
+
+        void put_double(const double d)
+        {
+            if(d != d || d - d != 0)
+            {
+                // NaN and infinity can not be represented in JSON
+                put_null();
+                return;
+            }
+            char buf[32];
+            int n = SNPRINTF(buf, sizeof(buf), "%.15g", d);
+            if(strtod(buf, 0) != d)
+                n = SNPRINTF(buf, sizeof(buf), "%.17g", d);
+            put_number(buf, n);
+        }
+
+        /* floats are printed with their own precision, so that 0.1f stays 0.1 */
+        void put_float(const float f)
+        {
+            if(f != f || f - f != 0)
+            {
+                put_null();
+                return;
+            }
+            char buf[32];
+            int n = SNPRINTF(buf, sizeof(buf), "%.6g", f);
+            if(static_cast<float>(strtod(buf, 0)) != f)
+                n = SNPRINTF(buf, sizeof(buf), "%.9g", f);
+            put_number(buf, n);
+        }
+
+        void put_string(const char *str, const size_t len)
+        {
+            static const char hex[] = "0123456789abcdef";
+            const char *run = str, *end = str + len;
+
+            put('"');
+            for(const char *p = str; p != end; ++p)
+            {
+                const unsigned char c = *p;
+                if(c >= 0x20 && c != '"' && c != '\\' && c != 0x7f)
+                    continue;
+
+                put(run, p - run);
+                run = p + 1;
+                put('\\');
+                switch(c)
+                {
+                    case '"': put('"'); break;
+                    case '\\': put('\\'); break;
+                    case '\b': put('b'); break;
+                    case '\f': put('f'); break;
+                    case '\n': put('n'); break;
+                    case '\r': put('r'); break;
+                    case '\t': put('t'); break;
+                    default:
+                        put("u00", 3);
+                        put(hex[c >> 4]);
+                        put(hex[c & 0xf]);
+                        break;
+                }
+            }
+            put(run, end - run);
+            put('"');
+        }
+
+        inline void put_string(const char *str) { put_string(str, strlen(str)); }
+    private:
+        writer(const writer &);
+        writer &operator=(const writer &);
+    };
+
+    namespace _writer_funcs
+    {
+        template<_json_values::type J>
+        struct scalar;
+
+        template<>
+        struct scalar<_json_values::null_type>
+        {
+            template<typename T>
+            inline static void write(writer &w, const T &) { w.put_null(); }
+        };
+
+        template<>
+        struct scalar<_json_values::boolean_type>
+        {
+            inline static void write(writer &w, const bool b) { w.put_bool(b); }
+        };
+
+        template<>
+        struct scalar<_json_values::int_type>
+        {
+            template<typename T>
+            inline static void write(writer &w, const T &v) { w.put_integer(v); }
+        };
+
+        template<>
+        struct scalar<_json_values::double_type>
+        {
+            template<typename T>
+            inline static void write(writer &w, const T &d) { w.put_double(d); }
+
+            inline static void write(writer &w, const float f) { w.put_float(f); }
+        };
+
+        template<>
+        struct scalar<_json_values::string_type>
+        {
+            inline static void write(writer &w, const std::string &str) { w.put_string(str.data(), str.size()); }
+
+            template<typename T>
+            inline static void write(writer &w, const T &str) { w.put_string(str.data(), str.size()); }
+        };
+    }
+
+    /* first use of a member table. a recursive type (a struct holding std::vector of itself) asks for its
+       own table again while it is being built: building hands the partially filled table back to that
+       thread, and other threads wait on the lock until the table is complete. without C++11 there is no
+       lock, so the first parse of each type has to happen before threads are started */
+    struct _table_once
+    {
+#if __cplusplus >= 201103L
+        std::atomic<bool> ready;
+#else
+        bool ready;
+#endif
+        bool building;
+
+        template<typename F>
+        inline void run(F build)
+        {
+#if __cplusplus >= 201103L
+            if(ready.load(std::memory_order_acquire))
+                return;
+            std::lock_guard<std::recursive_mutex> guard(lock());
+            if(ready.load(std::memory_order_relaxed) || building)
+                return;
+            building = true;
+            build();
+            building = false;
+            ready.store(true, std::memory_order_release);
+#else
+            if(ready || building)
+                return;
+            building = true;
+            build();
+            building = false;
+            ready = true;
+#endif
+        }
+
+#if __cplusplus >= 201103L
+        /* one lock for every table, so that types referring to each other can not deadlock */
+        static std::recursive_mutex &lock()
+        {
+            static std::recursive_mutex m;
+            return m;
+        }
+#endif
+    };
+
+    template<typename T>
+    class _value_info
+    {
+        template<typename S>
+        inline static void set_vparam(
+            _member_info &mi,
+            typename _type_checker::_enable<_type_checker::_has_self_type<S>::value>::type* = 0
+        ) { mi.list = _members<S>::get(); }
+
+        template<typename S>
+        inline static void set_vparam(
+            _member_info &mi,
+            typename _type_checker::_enable<
+                _type_checker::_is_vector<S>::value &&
+                !_type_checker::_is_bit_vector<S>::value
+            >::type* = 0
+        )
+        {
+            mi.ctor = _parser_funcs::assign_bridge<typename S::value_type>;
+            mi.push = push;
+            mi.size = size;
+            mi.resize = resize;
+            mi.at = at;
+            mi.elem = _value_info<typename S::value_type>::get();
+        }
+
+        template<typename S>
+        inline static void set_vparam(
+            _member_info &mi,
+            typename _type_checker::_enable<_type_checker::_is_bit_vector<S>::value>::type* = 0
+        )
+        {
+            mi.ctor = _parser_funcs::assign_bridge<bool>;
+            mi.size = size;
+            mi.resize = resize;
+            mi.at = bit_at;
+            mi.store_bit = store_bit;
+            mi.elem = _value_info<bool>::get();
+        }
+
+        template<typename S>
+        inline static void set_vparam(
+            _member_info &mi,
+            typename _type_checker::_enable<
+                _type_checker::get_type<S>::value == _json_values::int_type ||
+                _type_checker::get_type<S>::value == _json_values::double_type
+            >::type* = 0
+        )
+        {
+            mi.s = set_number;
+            mi.si = set_integer;
+            mi.w = write;
+        }
+
+        template<typename S>
+        inline static void set_vparam(
+            _member_info &mi,
+            typename _type_checker::_enable<
+                !_type_checker::_has_self_type<S>::value &&
+                !_type_checker::_is_vector<S>::value &&
+                !_type_checker::_is_string_ref<S>::value &&
+                _type_checker::get_type<S>::value != _json_values::int_type &&
+                _type_checker::get_type<S>::value != _json_values::double_type
+            >::type* = 0
+        )
+        {
+            mi.s = set;
+            mi.w = write;
+        }
+
+        template<typename S>
+        inline static void set_vparam(
+            _member_info &mi,
+            typename _type_checker::_enable<_type_checker::_is_string_ref<S>::value>::type* = 0
+        )
+        {
+            mi.s = set_ref;
+            mi.w = write;
+            mi.ref = true;
+        }
+    private:
+        static _member_info _info;
+        static _table_once once;
+
+        static bool set(void *o, const void *v)
+        {
+            *static_cast<T *>(o) = v ? *static_cast<const T *>(v) : T();
+            return true;
+        }
+
+        /* views receive a str_ref to the text */
+        static bool set_ref(void *o, const void *v)
+        {
+            if(!v)
+            {
+                *static_cast<T *>(o) = T();
+                return true;
+            }
+            const str_ref &r = *static_cast<const str_ref *>(v);
+            *static_cast<T *>(o) = T(r.data(), r.size());
+            return true;
+        }
+
+        /* numbers with a fraction or an exponent, and every number in picojson::value, arrive as double */
+        static bool set_number(void *o, const void *v)
+        {
+            return _parser_funcs::to_number(*static_cast<T *>(o), *static_cast<const double *>(v));
+        }
+
+        static bool set_integer(void *o, const bool negative, const uint64_t magnitude)
+        {
+            return _parser_funcs::to_number(*static_cast<T *>(o), negative, magnitude);
+        }
+
+        static void *push(void *v)
+        {
+            T &vec = *static_cast<T *>(v);
+            vec.push_back(typename T::value_type());
+            return &vec.back();
+        }
+
+        static size_t size(const void *v) { return static_cast<const T *>(v)->size(); }
+        static void resize(void *v, const size_t n) { static_cast<T *>(v)->resize(n); }
+        static const void *at(const void *v, const size_t i) { return &(*static_cast<const T *>(v))[i]; }
+
+        /* the bits of std::vector<bool> are read through constants and written by value */
+        static const void *bit_at(const void *v, const size_t i)
+        {
+            static const bool bits[2] = { false, true };
+            return &bits[(*static_cast<const T *>(v))[i] ? 1 : 0];
+        }
+
+        static void store_bit(void *v, const size_t i, const bool b)
+        {
+            T &vec = *static_cast<T *>(v);
+            if(i < vec.size())
+                vec[i] = b;
+            else
+                vec.push_back(b);
+        }
+
+        static void write(writer &w, const void *v)
+        {
+            _writer_funcs::scalar<_type_checker::get_type<T>::value>::write(w, *static_cast<const T *>(v));
+        }
+
+        static void reset(void *o) { _parser_funcs::reset_value(*static_cast<T *>(o)); }
+
+        static void build() { fill(_info); }
+    public:
+        /* fills type dependent fields. name and position are left to the caller */
+        static void fill(_member_info &mi)
+        {
+            mi.type = _type_checker::get_type<T>::value;
+            mi.reset = reset;
+            set_vparam<T>(mi);
+        }
+
+        /* describes an anonymous value of T, e.g. an element of std::vector<T> */
+        static const _member_info *get()
+        {
+            once.run(build);
+            return &_info;
+        }
+    };
+
+    template<typename T>
+    _member_info _value_info<T>::_info;
+
+    // zero initialized before any dynamic initialization, so get() works from static constructors too
+    template<typename T>
+    _table_once _value_info<T>::once;
+
+    /* a member declared by def. M gives inlined access to the member */
+    template<typename C, typename T, T C::*M>
+    struct _field
+    {
+        typedef C owner_type;
+        typedef T value_type;
+
+        inline static T &get(C &c) { return c.*M; }
+        inline static const T &get(const C &c) { return c.*M; }
+
+        static void fill(_member_info &mi, const char *name, const size_t name_len, const size_t pos)
+        {
+            mi.name = name;
+            mi.name_len = name_len;
+            mi.pos = pos;
+            _value_info<T>::fill(mi);
+        }
+    };
+
+    /* member table of C, built from the def declarations on first use */
+    template<typename C>
+    class _members
+    {
+        typedef typename _describe<C>::type described;
+    public:
+        enum { count = sizeof(described::_count_members(static_cast<_type_checker::_rank<NANOJSON_MAX_MEMBERS> *>(0))) - 1 };
+        enum { index_size = _type_checker::_ceil_pow2<count * 8>::value };
+    private:
+        template<int I, int N>
+        struct builder
+        {
+            inline static void fill(_member_info *infos)
+            {
+                described::_member(static_cast<_type_checker::_index<I> *>(0), infos + I);
+                builder<I + 1, N>::fill(infos);
+            }
+        };
+
+        template<int N>
+        struct builder<N, N>
+        {
+            inline static void fill(_member_info *) { }
+        };
+
+        static _member_info infos[count > 0 ? count : 1];
+        static unsigned short slots[index_size];
+        static _pos_list list;
+        static _table_once once;
+
+        static void build()
+        {
+            builder<0, count>::fill(infos);
+            list.build_index(slots, index_size);
+#ifdef NANOJSON_STATS
+            list.type_name = typeid(C).name();
+#endif
+        }
+    public:
+        static const _pos_list *get()
+        {
+            once.run(build);
+            return &list;
+        }
+    };
+
+    template<typename C>
+    _member_info _members<C>::infos[count > 0 ? count : 1];
+
+    template<typename C>
+    unsigned short _members<C>::slots[index_size];
+
+    template<typename C>
+    _pos_list _members<C>::list = { _members<C>::infos, _members<C>::count, 0, 0, 0, false
+#ifdef NANOJSON_STATS
+        , 0
+#endif
+    };
+
+    template<typename C>
+    _table_once _members<C>::once;
+
+    template<typename S>
+    class object
+    {
+    public:
+        typedef S self_type;
+
+        static _type_checker::_counter<0> _count_members(_type_checker::_rank<0> *);
+    };
+
+    /* read-only view of a whole file. regular files are mapped, others are read at once */
+    class mapped_file
+    {
+    private:
+        const char *ptr;
+        size_t length;
+        bool mapped;
+        std::vector<char> buffer;
+
+        mapped_file(const mapped_file &);
+        mapped_file &operator=(const mapped_file &);
+
+        void set_buffer()
+        {
+            ptr = buffer.empty() ? "" : &buffer[0];
+            length = buffer.size();
+        }
+    public:
+        mapped_file() : ptr(0), length(0), mapped(false) { }
+        mapped_file(const char *filename) : ptr(0), length(0), mapped(false) { open(filename); }
+        ~mapped_file() { close(); }
+
+        bool open(const char *filename)
+        {
+            close();
+#ifdef NANOJSON_POSIX
+            const int fd = ::open(filename, O_RDONLY);
+            if(fd < 0)
+                return false;
+
+            struct stat st;
+            if(fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            if(S_ISREG(st.st_mode) && st.st_size > 0)
+            {
+                void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(p != MAP_FAILED)
+                {
+                    madvise(p, st.st_size, MADV_SEQUENTIAL);
+                    ::close(fd);
+                    ptr = static_cast<const char *>(p);
+                    length = st.st_size;
+                    mapped = true;
+                    return true;
+                }
+            }
+
+            // pipes, devices or file systems without mmap support
+            size_t used = 0;
+            buffer.resize(S_ISREG(st.st_mode) && st.st_size > 0 ? st.st_size : 65536);
+            for(;;)
+            {
+                if(used == buffer.size())
+                    buffer.resize(buffer.size() * 2);
+                const ssize_t n = read(fd, &buffer[used], buffer.size() - used);
+                if(n < 0 && errno == EINTR)
+                    continue;
+                if(n < 0)
+                {
+                    ::close(fd);
+                    buffer.clear();
+                    return false;
+                }
+                if(n == 0)
+                    break;
+                used += n;
+            }
+            ::close(fd);
+            buffer.resize(used);
+#else
+            std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+            if(!ifs)
+                return false;
+            ifs.seekg(0, std::ios::end);
+            const std::streamoff size = ifs.tellg();
+            ifs.seekg(0, std::ios::beg);
+            buffer.resize(size > 0 ? static_cast<size_t>(size) : 0);
+            if(!buffer.empty() && !ifs.read(&buffer[0], buffer.size()))
+            {
+                buffer.clear();
+                return false;
+            }
+#endif
+            set_buffer();
+            return true;
+        }
+
+        void close()
+        {
+#ifdef NANOJSON_POSIX
+            if(mapped)
+                munmap(const_cast<char *>(ptr), length);
+#endif
+            std::vector<char>().swap(buffer);
+            ptr = 0;
+            length = 0;
+            mapped = false;
+        }
+
+        inline bool is_open() const { return ptr != 0; }
+        inline const char *data() const { return ptr; }
+        inline size_t size() const { return length; }
+    };
+
+    template<typename T>
+    class document;
+
+    template<typename T>
+    class lazy;
+
+    template<typename T>
+    class ndjson_reader;
+
+    template<typename T>
+    class push_parser;
+
+    class reader
+    {
+        template<typename T>
+        friend class ndjson_reader;
+        template<typename T>
+        friend class push_parser;
+        template<typename T>
+        friend class document;
+    private:
+        const char *filename;
+        mapped_file file;
+        unsigned int workers;
+        bool indexed;
+        const projection *proj;
+        std::vector<uint32_t> structurals;
+#ifdef NANOJSON_STATS
+        stats measured;
+#endif
+
+        inline unsigned int thread_count() const
+        {
+#if __cplusplus >= 201103L
+            return _parallel::threads(workers);
+#else
+            return 1;
+#endif
+        }
+
+        inline bool open_file(mapped_file &f)
+        {
+#ifdef NANOJSON_STATS
+            _stats_funcs::timer timer(measured.load_time);
+#endif
+            return filename && f.open(filename);
+        }
+
+        /* str_ref and string_view members point into the input, which only a document keeps alive */
+        template<typename T>
+        inline static void check_owned()
+        {
+#if __cplusplus >= 201103L
+            static_assert(!_type_checker::_has_views<T>::value, "types with str_ref members need parse_document");
+#else
+            (void)sizeof(_type_checker::_views_need_document<_type_checker::_has_views<T>::value>);
+#endif
+        }
+
+        template<typename T>
+        void map(T &result, const char *str, const size_t len, _string_pool *pool)
+        {
+            error_info err;
+            if(!try_map(result, str, len, pool, err, false))
+                throw __exception(err.code == error_info::not_object ? "root element must be object." : "json parse error.");
+        }
+
+        /* returns false instead of throwing. with classify, err tells what went wrong and where */
+        template<typename T>
+        bool try_map(T &result, const char *str, const size_t len, _string_pool *pool, error_info &err, const bool classify)
+        {
+#ifdef NANOJSON_STATS
+            ++measured.documents;
+            measured.bytes += len;
+            bool ok;
+            {
+                _stats_funcs::allocations allocs(measured);
+                ok = map_input(result, str, len, pool, err, classify);
+            }
+            if(!ok)
+                return false;
+            _stats_funcs::count_members(measured, &result, _members<T>::get());
+            ++measured.objects[_members<T>::get()->type_name];
+            return true;
+#else
+            return map_input(result, str, len, pool, err, classify);
+#endif
+        }
+
+        template<typename T>
+        void index_lazy(lazy<T> &out, const char *str, const size_t len)
+        {
+#ifdef NANOJSON_STATS
+            ++measured.documents;
+            measured.bytes += len;
+            _stats_funcs::allocations allocs(measured);
+            _stats_funcs::timer timer(measured.index_time);
+#endif
+            if(!out.index(str, len))
+                throw __exception("json parse error.");
+        }
+
+        template<typename T>
+        bool map_input(T &result, const char *str, const size_t len, _string_pool *pool, error_info &err,
+            const bool classify)
+        {
+            err.clear();
+
+            const char *p = str, *end = str + len;
+            while(p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                ++p;
+            if(p == end || *p != '{')
+            {
+                err.code = error_info::not_object;
+                err.offset = p - str;
+                return false;
+            }
+
+            const unsigned int threads = thread_count();
+            if(indexed && threads == 1)
+            {
+#ifdef NANOJSON_STATS
+                const double started = _stats_funcs::now();
+                double index_time = 0;
+                const bool ok = _parser_funcs::parse_indexed<T>(result, str, len, 0, structurals, pool, proj, &index_time);
+                measured.index_time += index_time;
+                measured.map_time += _stats_funcs::now() - started - index_time;
+                if(ok)
+#else
+                if(_parser_funcs::parse_indexed<T>(result, str, len, 0, structurals, pool, proj))
+#endif
+                    return true;
+            }
+            else
+            {
+#ifdef NANOJSON_STATS
+                _stats_funcs::timer timer(measured.parse_time);
+#endif
+                if(_parser_funcs::parse<T>(result, str, len, 0, 0, threads, pool, proj, &err))
+                    return true;
+                if(threads == 1)
+                    return false;
+            }
+
+            // only the single threaded decoder tells the reason, so it runs once more on the broken input
+            err.code = error_info::syntax_error;
+            if(classify)
+            {
+                err.clear();
+                _parser_funcs::parse<T>(result, str, len, 0, 0, 1, pool, proj, &err);
+            }
+            return false;
+        }
+
+        /* maps an already parsed picojson::value */
+        template<typename T>
+        bool map_value(T &result, picojson::value &val, error_info &err)
+        {
+            err.clear();
+            if(!val.is<picojson::object>())
+            {
+                err.code = error_info::not_object;
+                return false;
+            }
+
+#ifdef NANOJSON_STATS
+            bool ok;
+            {
+                _stats_funcs::allocations allocs(measured);
+                _stats_funcs::timer timer(measured.map_time);
+                ok = _parser_funcs::map_object(result, val.get<picojson::object>(), &err);
+            }
+            if(!ok)
+                return false;
+            _stats_funcs::count_members(measured, &result, _members<T>::get());
+            ++measured.objects[_members<T>::get()->type_name];
+            return true;
+#else
+            return _parser_funcs::map_object(result, val.get<picojson::object>(), &err);
+#endif
+        }
+    public:
+        reader() : filename(0), workers(1), indexed(false), proj(0) { }
+        reader(const char *filename) : filename(filename), workers(1), indexed(false), proj(0) { }
+        /* a file loaded by r is loaded again, since the mapping can not be shared */
+        reader(const reader &r) : filename(r.filename), workers(r.workers), indexed(r.indexed), proj(r.proj)
+        {
+            if(r.file.is_open())
+                open_file(file);
+        }
+        ~reader() { }
+
+        reader &operator=(const reader &r)
+        {
+            if(this == &r)
+                return *this;
+            filename = r.filename;
+            workers = r.workers;
+            indexed = r.indexed;
+            proj = r.proj;
+            file.close();
+            if(r.file.is_open())
+                open_file(file);
+            return *this;
+        }
+
+        /* number of threads used to map large arrays. 0 uses every core. has no effect before C++11 */
+        inline void set_threads(const unsigned int n) { workers = n; }
+
+        /* maps through a structural index built in a separate SIMD pass instead of tokenizing byte by byte.
+           the index is kept for the next parse. ignored while several threads are used */
+        inline void set_indexed(const bool on) { indexed = on; }
+
+        /* members ignored by p are skipped while parsing text. p must outlive the parses, 0 maps every member */
+        inline void set_projection(const projection *p) { proj = p; }
+
+#ifdef NANOJSON_STATS
+        /* counters of every parse since construction or reset_stats */
+        inline const stats &get_stats() const { return measured; }
+        inline void reset_stats() { measured.clear(); }
+#endif
+
+        /* maps the file so that following parse<T>() calls reuse it */
+        bool load(const char *filename)
+        {
+            this->filename = filename;
+            return open_file(file);
+        }
+
+        template<typename T>
+        T parse(const char *str, const size_t len)
+        {
+            T result;
+            parse_into(result, str, len);
+            return result;
+        }
+
+        /* overwrites result in place. strings and vectors keep their buffers, and existing vector elements are
+           reused. pointers and projected members which are not in the JSON are emptied, other missing
+           members are an error */
+        template<typename T>
+        inline void parse_into(T &result, const char *str, const size_t len)
+        {
+            check_owned<T>();
+            map(result, str, len, 0);
+        }
+
+        template<typename T>
+        inline void parse_into(T &result, const char *str) { parse_into(result, str, strlen(str)); }
+
+        template<typename T>
+        void parse_into(T &result)
+        {
+            if(file.is_open())
+            {
+                parse_into(result, file.data(), file.size());
+                return;
+            }
+
+            mapped_file f;
+            if(!open_file(f))
+                throw __exception("failed to open file.");
+            parse_into(result, f.data(), f.size());
+        }
+
+        /* same as parse_into, but failures are reported in err instead of thrown: what went wrong,
+           the offset where parsing stopped and the path of the value. result is unspecified on failure */
+        template<typename T>
+        bool parse_into(T &result, const char *str, const size_t len, error_info &err) NANOJSON_NOEXCEPT
+        {
+            check_owned<T>();
+            try
+            {
+                return try_map(result, str, len, 0, err, true);
+            }
+            catch(...)
+            {
+                err.code = _exception_code();
+                return false;
+            }
+        }
+
+        template<typename T>
+        bool parse_into(T &result, error_info &err) NANOJSON_NOEXCEPT
+        {
+            if(file.is_open())
+                return parse_into(result, file.data(), file.size(), err);
+
+            try
+            {
+                mapped_file f;
+                if(!open_file(f))
+                {
+                    err.clear();
+                    err.code = error_info::open_failed;
+                    return false;
+                }
+                return parse_into(result, f.data(), f.size(), err);
+            }
+            catch(...)
+            {
+                err.code = _exception_code();
+                return false;
+            }
+        }
+
+        template<typename T>
+        bool parse_into(T &result, picojson::value &val, error_info &err) NANOJSON_NOEXCEPT
+        {
+            try
+            {
+                return map_value(result, val, err);
+            }
+            catch(...)
+            {
+                err.code = _exception_code();
+                return false;
+            }
+        }
+
+        /* builds a picojson::value. when a is given, the nodes are allocated from it */
+        void parse_value(picojson::value &out, const char *str, const size_t len, picojson::arena *a = 0)
+        {
+            std::string err;
+#ifdef NANOJSON_STATS
+            ++measured.documents;
+            measured.bytes += len;
+            {
+                _stats_funcs::allocations allocs(measured);
+                _stats_funcs::timer timer(measured.dom_time);
+                picojson::parse(out, str, str + len, &err, a);
+            }
+            if(err.empty())
+                _stats_funcs::count_nodes(measured, out);
+#else
+            picojson::parse(out, str, str + len, &err, a);
+#endif
+            if(!err.empty())
+                throw __exception("json parse error.");
+        }
+
+        void parse_value(picojson::value &out, picojson::arena *a = 0)
+        {
+            if(file.is_open())
+            {
+                parse_value(out, file.data(), file.size(), a);
+                return;
+            }
+
+            mapped_file f;
+            if(!open_file(f))
+                throw __exception("failed to open file.");
+            parse_value(out, f.data(), f.size(), a);
+        }
+
+        /* parses into a document which owns a copy of str, so that str_ref members stay valid.
+           the copy reuses the buffer of the previous parse */
+        template<typename T>
+        void parse_document(document<T> &doc, const char *str, const size_t len)
+        {
+            doc.reset();
+            doc.map(*this, str, len, true);
+        }
+
+        /* same as parse_document, but str_ref members refer to str itself instead of a copy.
+           str must stay alive while doc is used */
+        template<typename T>
+        void parse_document_ref(document<T> &doc, const char *str, const size_t len)
+        {
+            doc.reset();
+            doc.map(*this, str, len, false);
+        }
+
+        /* parses the file given to the constructor or load. the document maps the file itself */
+        template<typename T>
+        void parse_document(document<T> &doc)
+        {
+            doc.reset();
+            if(!open_file(doc.file))
+            {
+                doc.discard();
+                throw __exception("failed to open file.");
+            }
+            doc.map(*this, doc.file.data(), doc.file.size(), false);
+        }
+
+        /* only indexes where each member is. str must stay alive while members of out are accessed */
+        template<typename T>
+        void parse_lazy(lazy<T> &out, const char *str, const size_t len)
+        {
+            out.reset();
+            index_lazy(out, str, len);
+        }
+
+        /* the file given to the constructor or load is mapped by out itself */
+        template<typename T>
+        void parse_lazy(lazy<T> &out)
+        {
+            out.reset();
+            if(!open_file(out.file))
+                throw __exception("failed to open file.");
+            index_lazy(out, out.file.data(), out.file.size());
+        }
+
+        /* maps an already parsed picojson::value */
+        template<typename T>
+        T parse(picojson::value &val)
+        {
+            T result;
+            error_info err;
+            if(!map_value(result, val, err))
+            {
+                if(err.code == error_info::not_object)
+                    throw __exception("root element must be object.");
+                throw __exception((std::string(err.message()) + ": " + err.path).c_str());
+            }
+            return result;
+        }
+
+        template<typename T>
+        inline T parse(const char *str) { return parse<T>(str, strlen(str)); }
+
+        template<typename T>
+        inline T parse()
+        {
+            if(file.is_open())
+                return parse<T>(file.data(), file.size());
+
+            mapped_file f;
+            if(!open_file(f))
+                throw __exception("failed to open file.");
+            return parse<T>(f.data(), f.size());
+        }
+    };
+
+    /* owns the input of a parse and the strings with escapes, so that str_ref members of the root stay valid */
+    template<typename T>
+    class document
+    {
+    private:
+        friend class reader;
+
+        mapped_file file;
+        std::vector<char> buffer;
+        _string_pool strings;
+        T root;
+
+        document(const document &);
+        document &operator=(const document &);
+
+        /* root is overwritten in place by the next parse, so its strings and vectors keep their capacity */
+        void reset()
+        {
+            strings.clear();
+            file.close();
+            buffer.clear();
+        }
+
+        /* after a failed parse root may still refer to the storage reset() released */
+        void discard()
+        {
+            reset();
+            root = T();
+        }
+
+        /* with copy, str is copied into buffer first and the views refer to the copy */
+        void map(reader &r, const char *str, const size_t len, const bool copy)
+        {
+            try
+            {
+                if(copy)
+                {
+                    buffer.assign(str, str + len);
+                    str = buffer.empty() ? "" : &buffer[0];
+                }
+                r.map(root, str, len, &strings);
+            }
+            catch(...)
+            {
+                discard();
+                throw;
+            }
+        }
+    public:
+        document() { }
+        ~document() { }
+
+        inline T &get() { return root; }
+        inline const T &get() const { return root; }
+        inline T &operator*() { return root; }
+        inline const T &operator*() const { return root; }
+        inline T *operator->() { return &root; }
+        inline const T *operator->() const { return &root; }
+    };
+
+    /* an object whose members are decoded from the input when they are first accessed */
+    template<typename T>
+    class lazy
+    {
+    private:
+        friend class reader;
+
+        mapped_file file;
+        _string_pool strings;
+        std::vector<const char *> spans;
+        std::vector<char> decoded;
+        T value;
+
+        lazy(const lazy &);
+        lazy &operator=(const lazy &);
+
+        void reset()
+        {
+            value = T();
+            strings.clear();
+            file.close();
+        }
+
+        bool index(const char *str, const size_t len)
+        {
+            const _pos_list *list = _members<T>::get();
+            spans.assign(list->count * 2, static_cast<const char *>(0));
+            decoded.assign(list->count, 0);
+            return _parser_funcs::index_object(str, str + len, list, spans.empty() ? 0 : &spans[0]);
+        }
+
+        /* finds the member by its offset */
+        template<typename M>
+        size_t slot(M T::*m) const
+        {
+            const size_t pos = reinterpret_cast<const char *>(&(value.*m)) - reinterpret_cast<const char *>(&value);
+            const _pos_list *list = _members<T>::get();
+            for(const _member_info *mi = list->begin(); mi != list->end(); ++mi)
+            {
+                if(mi->pos == pos)
+                    return mi - list->begin();
+            }
+            throw __exception("member not declared by def.");
+        }
+
+        void decode(const size_t i)
+        {
+            if(decoded[i])
+                return;
+            if(spans[i * 2])
+            {
+                const _member_info *mi = _members<T>::get()->begin() + i;
+                picojson::input<const char *> in(spans[i * 2], spans[i * 2 + 1]);
+                _parser_funcs::mapping_context ctx(reinterpret_cast<char *>(&value) + mi->pos, mi, 1, &strings);
+                // the value has to fill its span, e.g. 12abc is not a number
+                if(!picojson::_parse(ctx, in)
+                    || picojson::_scanners<bool>::skip_ws(in.cur(), spans[i * 2 + 1]) != spans[i * 2 + 1])
+                    throw __exception("json parse error.");
+            }
+            decoded[i] = 1;
+        }
+    public:
+        /* sized up front so that members can be asked for before any parse */
+        lazy() : spans(_members<T>::get()->count * 2, static_cast<const char *>(0)), decoded(_members<T>::get()->count, 0) { }
+        ~lazy() { }
+
+        /* decodes the member on first access. absent members keep their default value */
+        template<typename M>
+        M &get(M T::*m)
+        {
+            decode(slot(m));
+            return value.*m;
+        }
+
+        template<typename M>
+        bool has(M T::*m) const { return spans[slot(m) * 2] != 0; }
+
+        /* decodes every remaining member */
+        T &all()
+        {
+            for(size_t i = 0; i < decoded.size(); ++i)
+                decode(i);
+            return value;
+        }
+    };
+
+    /* reads newline delimited JSON, one T per line. the input buffer is reused between records */
+    template<typename T>
+    class ndjson_reader
+    {
+    public:
+        enum status
+        {
+            record,
+            parse_error,
+            end_of_stream
+        };
+    private:
+        std::ifstream file;
+        std::istream *in;
+        std::vector<char> buffer;
+        size_t head, tail;
+        size_t line_no;
+        std::string err;
+        bool eof;
+        const projection *proj;
+
+        ndjson_reader(const ndjson_reader &);
+        ndjson_reader &operator=(const ndjson_reader &);
+
+        inline static bool is_space(const char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+        /* moves the unread bytes to the front and appends more input. returns false when nothing was read */
+        bool fill()
+        {
+            if(head != 0)
+            {
+                memmove(&buffer[0], &buffer[head], tail - head);
+                tail -= head;
+                head = 0;
+            }
+            if(tail == buffer.size())
+                buffer.resize(buffer.size() * 2);
+
+            in->read(&buffer[tail], buffer.size() - tail);
+            const size_t n = static_cast<size_t>(in->gcount());
+            tail += n;
+            if(n == 0)
+                eof = true;
+            return n != 0;
+        }
+
+        bool next_line(const char *&str, size_t &len)
+        {
+            size_t scanned = head;
+            for(;;)
+            {
+                const char *p = static_cast<const char *>(memchr(&buffer[0] + scanned, '\n', tail - scanned));
+                if(p)
+                {
+                    str = &buffer[head];
+                    len = p - str;
+                    head = p - &buffer[0] + 1;
+                    return true;
+                }
+                // fill() moves the unread bytes, so remember how much of them was already searched
+                const size_t searched = tail - head;
+                if(eof || !fill())
+                    break;
+                scanned = head + searched;
+            }
+
+            if(head == tail)
+                return false;
+            // the last line has no line break
+            str = &buffer[head];
+            len = tail - head;
+            head = tail;
+            return true;
+        }
+
+        void init(const size_t buffer_size)
+        {
+            buffer.resize(buffer_size > 0 ? buffer_size : 1);
+            head = tail = 0;
+            line_no = 0;
+            eof = false;
+            proj = 0;
+        }
+    public:
+        ndjson_reader(std::istream &is, const size_t buffer_size = 65536) : in(&is)
+        {
+            reader::check_owned<T>();
+            init(buffer_size);
+        }
+        ndjson_reader(const char *filename, const size_t buffer_size = 65536)
+            : file(filename, std::ios::in | std::ios::binary), in(&file)
+        {
+            reader::check_owned<T>();
+            init(buffer_size);
+        }
+        ~ndjson_reader() { }
+
+        /* reads the next non-empty line into out. on parse_error, out is left in an unspecified state
+           and error() tells the reason. following lines can still be read */
+        status next(T &out)
+        {
+            if(in == &file && !file.is_open())
+                throw __exception("failed to open file.");
+
+            const char *str;
+            size_t len;
+            for(;;)
+            {
+                if(!next_line(str, len))
+                    return end_of_stream;
+                ++line_no;
+
+                if(is_blank(str, len))
+                    continue;
+                return parse_line(out, str, len, err, proj) ? record : parse_error;
+            }
+        }
+    private:
+        inline static bool is_blank(const char *str, const size_t len)
+        {
+            for(const char *last = str + len; str != last; ++str)
+                if(!is_space(*str))
+                    return false;
+            return true;
+        }
+
+#if __cplusplus >= 201103L
+        /* moves the records which parsed to the front, swapping rather than copying so that the broken
+           ones give their buffers to the elements after them, and drops the rest */
+        static void compact(std::vector<T> &out, const std::vector<char> &ok)
+        {
+            size_t kept = 0;
+            for(size_t i = 0; i < ok.size(); ++i)
+            {
+                if(!ok[i])
+                    continue;
+                if(kept != i)
+                    std::swap(out[kept], out[i]);
+                ++kept;
+            }
+            out.resize(kept);
+        }
+#endif
+
+        /* maps a single non-blank line into out */
+        static bool parse_line(T &out, const char *str, const size_t len, std::string &err, const projection *proj)
+        {
+            const char *p = str, *last = str + len;
+            while(p != last && is_space(*p))
+                ++p;
+
+            err.clear();
+            if(p == last || *p != '{')
+            {
+                err = "root element must be object.";
+                return false;
+            }
+
+            // overwritten in place, so the strings and vectors of the previous record are reused
+            return _parser_funcs::parse<T>(out, p, last - p, &err, 0, 1, 0, proj);
+        }
+    public:
+        /* calls f(T &) for each record and on_error(size_t line, const std::string &message) for each broken line.
+           returns the number of records */
+        template<typename F, typename E>
+        size_t each(F f, E on_error)
+        {
+            T rec;
+            size_t count = 0;
+            for(;;)
+            {
+                switch(next(rec))
+                {
+                    case record:
+                        f(rec);
+                        ++count;
+                        break;
+                    case parse_error:
+                        on_error(line_no, err);
+                        break;
+                    default:
+                        return count;
+                }
+            }
+        }
+
+        /* same as above, broken lines are skipped */
+        template<typename F>
+        size_t each(F f) { return each(f, &ndjson_reader::ignore_error); }
+
+#if __cplusplus >= 201103L
+        /* parses a whole NDJSON buffer on threads threads (0: one per core) and replaces out with the records
+           in input order. broken lines are skipped and returned, index is the line number starting from 1.
+           the elements already in out are overwritten in place, so their strings and vectors are reused */
+        static std::vector<batch_error> parse_all(
+            const char *str, const size_t len, std::vector<T> &out, const unsigned int threads = 0,
+            const projection *proj = 0)
+        {
+            reader::check_owned<T>();
+            struct part
+            {
+                size_t first;       // slot in out of the first record
+                size_t records;
+                size_t lines;
+                std::vector<batch_error> errors;
+            };
+
+            const unsigned int n = _parallel::threads(threads);
+
+            // cut the buffer at line breaks into several chunks per thread
+            size_t chunk = len / (n * 8);
+            if(chunk < 65536)
+                chunk = 65536;
+            else if(chunk > 4194304)
+                chunk = 4194304;
+
+            const char *last = str + len;
+            std::vector<const char *> bounds(1, str);
+            for(const char *p = str; static_cast<size_t>(last - p) > chunk; )
+            {
+                const char *nl = static_cast<const char *>(memchr(p + chunk, '\n', last - p - chunk));
+                if(!nl)
+                    break;
+                p = nl + 1;
+                bounds.push_back(p);
+            }
+            if(bounds.back() != last)
+                bounds.push_back(last);
+
+            // count the non-blank lines first, so that every record has its slot in out before parsing
+            std::vector<part> parts(bounds.size() - 1);
+            _parallel::run(parts.size(), n, [&](const size_t i)
+            {
+                part &pt = parts[i];
+                pt.records = pt.lines = 0;
+                for(const char *p = bounds[i], *end = bounds[i + 1]; p != end; )
+                {
+                    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+                    const char *eol = nl ? nl : end;
+                    ++pt.lines;
+                    if(!is_blank(p, eol - p))
+                        ++pt.records;
+                    p = nl ? nl + 1 : end;
+                }
+            });
+
+            size_t total = 0;
+            for(part &pt : parts)
+            {
+                pt.first = total;
+                total += pt.records;
+            }
+            out.resize(total);
+            std::vector<char> ok(total, 0);
+
+            _parallel::run(parts.size(), n, [&](const size_t i)
+            {
+                part &pt = parts[i];
+                std::string err;
+                size_t line = 0, slot = pt.first;
+                for(const char *p = bounds[i], *end = bounds[i + 1]; p != end; )
+                {
+                    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+                    const char *eol = nl ? nl : end;
+                    ++line;
+                    if(!is_blank(p, eol - p))
+                    {
+                        if(parse_line(out[slot], p, eol - p, err, proj))
+                            ok[slot] = 1;
+                        else
+                            pt.errors.push_back(batch_error{ line, err });
+                        ++slot;
+                    }
+                    p = nl ? nl + 1 : end;
+                }
+            });
+
+            std::vector<batch_error> errors;
+            size_t offset = 0;
+            for(part &pt : parts)
+            {
+                for(batch_error &e : pt.errors)
+                {
+                    e.index += offset;
+                    errors.push_back(std::move(e));
+                }
+                offset += pt.lines;
+            }
+            compact(out, ok);
+            return errors;
+        }
+
+        /* parses independent documents, each holding one object. index of an error is the position in docs.
+           the elements already in out are overwritten in place as above */
+        static std::vector<batch_error> parse_all(
+            const std::vector<std::string> &docs, std::vector<T> &out, const unsigned int threads = 0,
+            const projection *proj = 0)
+        {
+            reader::check_owned<T>();
+            out.resize(docs.size());
+            std::vector<std::string> messages(docs.size());
+            std::vector<char> ok(docs.size(), 0);
+            _parallel::run(docs.size(), _parallel::threads(threads), [&](const size_t i)
+            {
+                ok[i] = parse_line(out[i], docs[i].data(), docs[i].size(), messages[i], proj);
+            });
+
+            std::vector<batch_error> errors;
+            for(size_t i = 0; i < docs.size(); ++i)
+            {
+                if(!ok[i])
+                    errors.push_back(batch_error{ i, std::move(messages[i]) });
+            }
+            compact(out, ok);
+            return errors;
+        }
+#endif
+
+        /* line number of the last line read, starting from 1 */
+        inline size_t line() const { return line_no; }
+
+        /* members ignored by p are skipped. p must outlive the reads */
+        inline void set_projection(const projection *p) { proj = p; }
+        inline const std::string &error() const { return err; }
+        inline bool is_open() const { return in != &file || file.is_open(); }
+    private:
+        inline static void ignore_error(size_t, const std::string &) { }
+    };
+
+    /* maps a document which arrives in pieces, e.g. from a socket. every piece is consumed as soon as it is fed;
+       only a token cut off at the end of a piece is kept until the next one. open arrays and objects are held
+       on an explicit stack instead of the call stack, so parsing can stop and resume between any two bytes */
+    template<typename T>
+    class push_parser
+    {
+    private:
+        enum state
+        {
+            value,          // a value for target
+            first_item,     // after '[': a value or ']'
+            next_item,      // after an element: ',' or ']'
+            first_key,      // after '{': a key or '}'
+            key,            // after ',' in an object
+            colon,
+            next_member,    // after a member: ',' or '}'
+            done
+        };
+
+        enum token_type
+        {
+            no_token,
+            string_token,
+            key_token,
+            scalar_token
+        };
+
+        /* an open array or object. out is 0 while skipping a value which has no member */
+        struct frame
+        {
+            void *out;
+            const _member_info *info;
+            size_t items, reusable;
+            bool array;
+            _seen_members seen;     // objects only
+        };
+
+        T &out;
+        _member_info root;
+        std::vector<frame> stack;
+        state st;
+        void *target;
+        const _member_info *target_info;    // 0 while skipping
+        bool bit;                           // target for an element of std::vector<bool>, stored once it is mapped
+        token_type token;
+        std::string pending;                // the part of a token seen so far
+        bool escape;                        // pending ends just after a backslash
+        bool plain;                         // no escapes or control characters so far. such keys are not decoded
+        std::string key_buffer;
+        const projection *proj;
+        const char *piece, *piece_end;
+        size_t lines;
+        std::string err;
+        bool failed;
+
+        push_parser(const push_parser &);
+        push_parser &operator=(const push_parser &);
+
+        /* p is inside a string. returns the position after the closing quote, or 0 when the string goes on */
+        static const char *string_end(const char *p, const char *end, bool &escape, bool &plain)
+        {
+            if(escape)
+            {
+                if(p == end)
+                    return 0;
+                ++p;
+                escape = false;
+            }
+            for(;;)
+            {
+                p = picojson::_scanners<bool>::scan_string(p, end);
+                if(p == end)
+                    return 0;
+                if(*p == '"')
+                    return p + 1;
+                plain = false;
+                if(*p == '\\' && ++p == end)
+                {
+                    escape = true;
+                    return 0;
+                }
+                ++p;    // control characters are rejected when the token is mapped
+            }
+        }
+
+        /* numbers and literals end at a delimiter. the parser checks the contents */
+        static const char *scalar_end(const char *p, const char *end)
+        {
+            while(p != end && *p != ',' && *p != ']' && *p != '}' && !picojson::_is_ws(*p))
+                ++p;
+            return p;
+        }
+
+        bool fail_at(const char *near, const char *near_end, const char *pos)
+        {
+            picojson::_syntax_error(err, static_cast<int>(lines + 1 + std::count(piece, pos, '\n')), near, near_end);
+            failed = true;
+            return false;
+        }
+
+        inline bool fail_at(const char *p) { return fail_at(p, piece_end, p); }
+
+        bool fail(const char *message)
+        {
+            err = message;
+            failed = true;
+            return false;
+        }
+
+        /* after a complete value */
+        inline void close_value()
+        {
+            if(stack.empty())
+                st = done;
+            else
+                st = stack.back().array ? next_item : next_member;
+        }
+
+        bool open(const char c)
+        {
+            frame f;
+            f.out = target_info ? target : 0;
+            f.info = target_info;
+            f.items = 0;
+            f.reusable = 0;
+            f.array = c == '[';
+            if(target_info)
+            {
+                if(target_info->type != (f.array ? _json_values::array_type : _json_values::object_type))
+                    return false;
+                // elements already in the vector are overwritten so that their buffers are reused
+                if(f.array)
+                    f.reusable = target_info->size(target);
+                else
+                    f.seen.clear(target_info->list->count);
+            }
+            stack.push_back(f);
+            st = f.array ? first_item : first_key;
+            return true;
+        }
+
+        /* fails when an object misses a member */
+        bool close()
+        {
+            frame &f = stack.back();
+            if(f.out && f.array && f.items < f.reusable)
+                f.info->resize(f.out, f.items);
+            if(f.out && !f.array)
+            {
+                error_info e;
+                if(!_parser_funcs::finish_object(f.out, f.info->list, f.seen, proj, &e))
+                    return fail((std::string(e.message()) + ": " + e.path).c_str());
+            }
+            stack.pop_back();
+            close_value();
+            return true;
+        }
+
+        /* points target at the next element of the innermost array */
+        void element()
+        {
+            frame &f = stack.back();
+            if(!f.out)
+            {
+                target = 0;
+                target_info = 0;
+                return;
+            }
+            if(f.info->store_bit)
+                target = &bit;
+            else
+                target = f.items < f.reusable ? const_cast<void *>(f.info->at(f.out, f.items)) : f.info->push(f.out);
+            target_info = f.info->elem;
+            ++f.items;
+        }
+
+        /* [first, last) is a whole token, quotes included */
+        bool map_token(const token_type type, const char *first, const char *last)
+        {
+            if(type == key_token)
+            {
+                const char *k = first + 1;
+                size_t len = last - 1 - k;
+                if(!plain)
+                {
+                    key_buffer.clear();
+                    picojson::input<const char *> in(k, last);
+                    if(!picojson::_parse_string(key_buffer, in) || in.cur() != last)
+                        return false;
+                    k = key_buffer.data();
+                    len = key_buffer.size();
+                }
+                frame &f = stack.back();
+                const _member_info *mi = f.out ? f.info->list->find(k, len) : 0;
+                if(mi && proj && proj->ignores(mi))
+                    mi = 0;
+                if(mi)
+                    f.seen.add(mi - f.info->list->begin());     // a failing value stops the parse anyway
+                target = mi ? static_cast<char *>(f.out) + mi->pos : 0;
+                target_info = mi;
+                st = colon;
+                return true;
+            }
+
+            if(map_value(first, last) != last)
+                return false;
+            close_value();
+            return true;
+        }
+
+        /* maps the value at first to target. returns the position after it, or 0 */
+        const char *map_value(const char *first, const char *last)
+        {
+            picojson::input<const char *> in(first, last);
+            bool ok;
+            if(target_info)
+            {
+                _parser_funcs::mapping_context ctx(target, target_info);
+                ok = picojson::_parse(ctx, in);
+                if(ok && target == &bit)
+                {
+                    const frame &f = stack.back();
+                    f.info->store_bit(f.out, f.items - 1, bit);
+                }
+            }
+            else
+            {
+                picojson::null_parse_context ctx;
+                ok = picojson::_parse(ctx, in);
+            }
+            return ok ? in.cur() : 0;
+        }
+
+        /* p is at the first character of a token. returns the position after it, or end when it goes on */
+        const char *start_token(const token_type type, const char *p, const char *end)
+        {
+            const char *q;
+            escape = false;
+            plain = true;
+            if(type == string_token)
+            {
+                // most strings end within the piece, so they are mapped without looking for the end first
+                if((q = map_value(p, end)))
+                {
+                    close_value();
+                    return q;
+                }
+                q = string_end(p + 1, end, escape, plain);
+                if(q)
+                {
+                    fail_at(p);
+                    return 0;
+                }
+            }
+            else if(type == scalar_token)
+            {
+                q = scalar_end(p + 1, end);
+                if(q == end)
+                    q = 0;
+            }
+            else
+                q = string_end(p + 1, end, escape, plain);
+
+            if(!q)
+            {
+                token = type;
+                pending.assign(p, end);
+                return end;
+            }
+            if(!map_token(type, p, q))
+            {
+                fail_at(p);
+                return 0;
+            }
+            return q;
+        }
+
+        /* continues the token left over from the previous piece */
+        const char *resume_token(const char *p, const char *end)
+        {
+            const char *q;
+            if(token == scalar_token)
+            {
+                q = scalar_end(p, end);
+                pending.append(p, q);
+                if(q == end)
+                    return end;
+            }
+            else
+            {
+                q = string_end(p, end, escape, plain);
+                pending.append(p, q ? q : end);
+                if(!q)
+                    return end;
+            }
+
+            const token_type type = token;
+            token = no_token;
+            if(!map_token(type, pending.data(), pending.data() + pending.size()))
+            {
+                fail_at(pending.data(), pending.data() + pending.size(), q);
+                return 0;
+            }
+            return q;
+        }
+    public:
+        /* the document is mapped into out, which is overwritten in place like reader::parse_into */
+        explicit push_parser(T &out) : out(out), bit(false), proj(0)
+        {
+            reader::check_owned<T>();
+            root = _member_info();
+            root.type = _json_values::object_type;
+            root.list = _members<T>::get();
+            reset();
+        }
+
+        /* starts over, e.g. for the next document */
+        void reset()
+        {
+            stack.clear();
+            st = value;
+            target = &out;
+            target_info = &root;
+            token = no_token;
+            pending.clear();
+            escape = false;
+            plain = true;
+            piece = piece_end = 0;
+            lines = 0;
+            err.clear();
+            failed = false;
+        }
+
+        /* consumes the next piece. returns false on error, after which every call fails until reset */
+        bool feed(const char *data, const size_t len)
+        {
+            if(failed)
+                return false;
+            const char *p = data, *end = data + len;
+            piece = data;
+            piece_end = end;
+
+            if(token != no_token && !(p = resume_token(p, end)))
+                return false;
+            while(p != end)
+            {
+                if(picojson::_is_ws(*p) && (p = picojson::_scanners<bool>::skip_ws(p, end)) == end)
+                    break;
+
+                const char c = *p;
+                switch(st)
+                {
+                    case first_item:
+                        if(c == ']')
+                        {
+                            close();
+                            ++p;
+                            continue;
+                        }
+                        element();
+                        st = value;
+                        // fall through
+                    case value:
+                        if(stack.empty() && c != '{')
+                            return fail("root element must be object");
+                        if(c == '{' || c == '[')
+                        {
+                            if(!open(c))
+                                return fail_at(p);
+                            ++p;
+                        }
+                        else if(!(p = start_token(c == '"' ? string_token : scalar_token, p, end)))
+                            return false;
+                        continue;
+                    case next_item:
+                        if(c == ',')
+                        {
+                            element();
+                            st = value;
+                            ++p;
+                            continue;
+                        }
+                        if(c != ']')
+                            return fail_at(p);
+                        close();
+                        ++p;
+                        continue;
+                    case first_key:
+                        if(c == '}')
+                        {
+                            if(!close())
+                                return false;
+                            ++p;
+                            continue;
+                        }
+                        // fall through
+                    case key:
+                        if(c != '"')
+                            return fail_at(p);
+                        if(!(p = start_token(key_token, p, end)))
+                            return false;
+                        continue;
+                    case colon:
+                        if(c != ':')
+                            return fail_at(p);
+                        st = value;
+                        ++p;
+                        continue;
+                    case next_member:
+                        if(c == ',')
+                        {
+                            st = key;
+                            ++p;
+                            continue;
+                        }
+                        if(c != '}')
+                            return fail_at(p);
+                        if(!close())
+                            return false;
+                        ++p;
+                        continue;
+                    case done:
+                        return fail("unexpected data after the root element");
+                }
+            }
+            lines += std::count(data, end, '\n');
+            return true;
+        }
+
+        inline bool feed(const std::string &data) { return feed(data.data(), data.size()); }
+
+        /* members ignored by p are skipped. p must outlive the parser */
+        inline void set_projection(const projection *p) { proj = p; }
+
+        /* ends the input. returns false when the document is incomplete or broken */
+        bool finish()
+        {
+            if(failed)
+                return false;
+            if(token == scalar_token)
+            {
+                // a number at the very end has no delimiter after it
+                token = no_token;
+                piece = piece_end = pending.data();
+                if(!map_token(scalar_token, pending.data(), pending.data() + pending.size()))
+                    return fail_at(pending.data(), pending.data() + pending.size(), pending.data());
+            }
+            if(token != no_token || st != done)
+                return fail("unexpected end of input");
+            return true;
+        }
+
+        /* whether a whole document has been mapped */
+        inline bool complete() const { return st == done && token == no_token; }
+        inline const std::string &error() const { return err; }
+    };
+
+    /* MessagePack and CBOR. the same def declarations and member tables as JSON are used, and the
+       encoders and decoders are generated for each type like _parser_funcs::typed_context */
+    namespace _binary_funcs
+    {
+        struct input
+        {
+            const char *p, *end;
+            std::string chunks;     // CBOR text sent in pieces
+
+            input(const char *data, const size_t len) : p(data), end(data + len) { }
+
+            inline bool has(const size_t n) const { return static_cast<size_t>(end - p) >= n; }
+
+            /* reads an n byte big endian number */
+            inline bool get(uint64_t &v, const int n)
+            {
+                if(!has(n))
+                    return false;
+                v = 0;
+                for(int i = 0; i < n; ++i)
+                    v = (v << 8) | static_cast<unsigned char>(*p++);
+                return true;
+            }
+
+            inline bool bytes(const char *&s, const uint64_t n)
+            {
+                if(n > static_cast<uint64_t>(end - p))
+                    return false;
+                s = p;
+                p += n;
+                return true;
+            }
+        };
+
+        /* the header of a value. strings are read whole, containers only up to their length */
+        struct item
+        {
+            enum kind_type
+            {
+                nil,
+                boolean,
+                positive,
+                negative,       // the value is -n
+                real,
+                string,
+                array,
+                map,
+                other,          // binary data, extensions and simple values nobody maps
+                stop            // end of an indefinite container (CBOR)
+            };
+
+            kind_type kind;
+            bool b;
+            uint64_t n;             // magnitude of integers, length of strings, arrays and maps
+            double d;
+            const char *s;
+            bool transient;         // s points to input::chunks, which the next value overwrites
+            bool indefinite;        // the container ends with a stop item instead of a length
+        };
+
+        inline void put_be(std::string &b, const uint64_t v, const int n)
+        {
+            for(int i = n - 1; i >= 0; --i)
+                b.push_back(static_cast<char>(v >> (i * 8)));
+        }
+
+        inline void put_tagged(std::string &b, const unsigned int tag, const uint64_t v, const int n)
+        {
+            b.push_back(static_cast<char>(tag));
+            put_be(b, v, n);
+        }
 
-    class reader
+        inline bool read_string(input &in, item &it, const uint64_t n)
+        {
+            it.kind = item::string;
+            it.n = n;
+            return in.bytes(it.s, n);
+        }
+
+        inline bool read_other(input &in, item &it, const uint64_t n)
+        {
+            const char *s;
+            it.kind = item::other;
+            return in.bytes(s, n);
+        }
+
+        inline bool read_container(item &it, const item::kind_type kind, const uint64_t n)
+        {
+            it.kind = kind;
+            it.n = n;
+            return true;
+        }
+
+        struct msgpack
+        {
+            static void put_nil(std::string &b) { b.push_back(static_cast<char>(0xc0)); }
+            static void put_bool(std::string &b, const bool v) { b.push_back(static_cast<char>(v ? 0xc3 : 0xc2)); }
+
+            static void put_unsigned(std::string &b, const uint64_t v)
+            {
+                if(v < 0x80)
+                    b.push_back(static_cast<char>(v));
+                else if(v <= 0xff)
+                    put_tagged(b, 0xcc, v, 1);
+                else if(v <= 0xffff)
+                    put_tagged(b, 0xcd, v, 2);
+                else if(v <= 0xffffffffULL)
+                    put_tagged(b, 0xce, v, 4);
+                else
+                    put_tagged(b, 0xcf, v, 8);
+            }
+
+            /* -m in two's complement */
+            static void put_negative(std::string &b, const uint64_t m)
+            {
+                if(m <= 32)
+                    b.push_back(static_cast<char>(0x100 - m));
+                else if(m <= 0x80)
+                    put_tagged(b, 0xd0, 0 - m, 1);
+                else if(m <= 0x8000)
+                    put_tagged(b, 0xd1, 0 - m, 2);
+                else if(m <= 0x80000000ULL)
+                    put_tagged(b, 0xd2, 0 - m, 4);
+                else
+                    put_tagged(b, 0xd3, 0 - m, 8);
+            }
+
+            static void put_float(std::string &b, const float f)
+            {
+                uint32_t u;
+                memcpy(&u, &f, sizeof(u));
+                put_tagged(b, 0xca, u, 4);
+            }
+
+            static void put_double(std::string &b, const double d)
+            {
+                uint64_t u;
+                memcpy(&u, &d, sizeof(u));
+                put_tagged(b, 0xcb, u, 8);
+            }
+
+            /* str 32, array 32 and map 32 are the largest forms */
+            static void check_length(const size_t n)
+            {
+                if(static_cast<uint64_t>(n) > 0xffffffffULL)
+                    throw __exception("length too large for msgpack.");
+            }
+
+            static void put_string(std::string &b, const char *s, const size_t n)
+            {
+                check_length(n);
+                if(n < 32)
+                    b.push_back(static_cast<char>(0xa0 | n));
+                else if(n <= 0xff)
+                    put_tagged(b, 0xd9, n, 1);
+                else if(n <= 0xffff)
+                    put_tagged(b, 0xda, n, 2);
+                else
+                    put_tagged(b, 0xdb, n, 4);
+                b.append(s, n);
+            }
+
+            static void put_array(std::string &b, const size_t n)
+            {
+                check_length(n);
+                if(n < 16)
+                    b.push_back(static_cast<char>(0x90 | n));
+                else if(n <= 0xffff)
+                    put_tagged(b, 0xdc, n, 2);
+                else
+                    put_tagged(b, 0xdd, n, 4);
+            }
+
+            static void put_map(std::string &b, const size_t n)
+            {
+                check_length(n);
+                if(n < 16)
+                    b.push_back(static_cast<char>(0x80 | n));
+                else if(n <= 0xffff)
+                    put_tagged(b, 0xde, n, 2);
+                else
+                    put_tagged(b, 0xdf, n, 4);
+            }
+
+            static bool read(input &in, item &it)
+            {
+                if(!in.has(1))
+                    return false;
+                const unsigned int c = static_cast<unsigned char>(*in.p++);
+                it.transient = it.indefinite = false;
+                if(c < 0x80)
+                    return read_container(it, item::positive, c);
+                if(c >= 0xe0)
+                    return read_container(it, item::negative, 0x100 - c);
+                if(c < 0x90)
+                    return read_container(it, item::map, c & 0xf);
+                if(c < 0xa0)
+                    return read_container(it, item::array, c & 0xf);
+                if(c < 0xc0)
+                    return read_string(in, it, c & 0x1f);
+
+                uint64_t v;
+                switch(c)
+                {
+                    case 0xc0:
+                        it.kind = item::nil;
+                        return true;
+                    case 0xc2:
+                    case 0xc3:
+                        it.kind = item::boolean;
+                        it.b = c == 0xc3;
+                        return true;
+                    case 0xc4: case 0xc5: case 0xc6:    // bin
+                        return in.get(v, 1 << (c - 0xc4)) && read_other(in, it, v);
+                    case 0xc7: case 0xc8: case 0xc9:    // ext, followed by its type
+                        return in.get(v, 1 << (c - 0xc7)) && read_other(in, it, v + 1);
+                    case 0xca:
+                        {
+                            if(!in.get(v, 4))
+                                return false;
+                            const uint32_t u = static_cast<uint32_t>(v);
+                            float f;
+                            memcpy(&f, &u, sizeof(f));
+                            it.kind = item::real;
+                            it.d = f;
+                        }
+                        return true;
+                    case 0xcb:
+                        if(!in.get(v, 8))
+                            return false;
+                        memcpy(&it.d, &v, sizeof(it.d));
+                        it.kind = item::real;
+                        return true;
+                    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+                        return in.get(v, 1 << (c - 0xcc)) && read_container(it, item::positive, v);
+                    case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+                        {
+                            const int n = 1 << (c - 0xd0);
+                            if(!in.get(v, n))
+                                return false;
+                            const uint64_t sign = static_cast<uint64_t>(1) << (n * 8 - 1);
+                            if(!(v & sign))
+                                return read_container(it, item::positive, v);
+                            // (sign << 1) wraps to 0 for 64 bits, which is what two's complement needs
+                            return read_container(it, item::negative, (sign << 1) - v);
+                        }
+                    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:     // fixext
+                        return read_other(in, it, 1 + (1 << (c - 0xd4)));
+                    case 0xd9: case 0xda: case 0xdb:
+                        return in.get(v, 1 << (c - 0xd9)) && read_string(in, it, v);
+                    case 0xdc: case 0xdd:
+                        return in.get(v, c == 0xdc ? 2 : 4) && read_container(it, item::array, v);
+                    case 0xde: case 0xdf:
+                        return in.get(v, c == 0xde ? 2 : 4) && read_container(it, item::map, v);
+                }
+                return false;   // 0xc1 is never used
+            }
+
+            static inline bool at_stop(input &) { return false; }
+        };
+
+        struct cbor
+        {
+            static void put_head(std::string &b, const unsigned int major, const uint64_t v)
+            {
+                const unsigned int m = major << 5;
+                if(v < 24)
+                    b.push_back(static_cast<char>(m | v));
+                else if(v <= 0xff)
+                    put_tagged(b, m | 24, v, 1);
+                else if(v <= 0xffff)
+                    put_tagged(b, m | 25, v, 2);
+                else if(v <= 0xffffffffULL)
+                    put_tagged(b, m | 26, v, 4);
+                else
+                    put_tagged(b, m | 27, v, 8);
+            }
+
+            static void put_nil(std::string &b) { b.push_back(static_cast<char>(0xf6)); }
+            static void put_bool(std::string &b, const bool v) { b.push_back(static_cast<char>(v ? 0xf5 : 0xf4)); }
+            static void put_unsigned(std::string &b, const uint64_t v) { put_head(b, 0, v); }
+            static void put_negative(std::string &b, const uint64_t m) { put_head(b, 1, m - 1); }
+
+            static void put_float(std::string &b, const float f)
+            {
+                uint32_t u;
+                memcpy(&u, &f, sizeof(u));
+                put_tagged(b, 0xfa, u, 4);
+            }
+
+            static void put_double(std::string &b, const double d)
+            {
+                uint64_t u;
+                memcpy(&u, &d, sizeof(u));
+                put_tagged(b, 0xfb, u, 8);
+            }
+
+            static void put_string(std::string &b, const char *s, const size_t n)
+            {
+                put_head(b, 3, n);
+                b.append(s, n);
+            }
+
+            static void put_array(std::string &b, const size_t n) { put_head(b, 4, n); }
+            static void put_map(std::string &b, const size_t n) { put_head(b, 5, n); }
+
+            static bool argument(input &in, const unsigned int ai, uint64_t &v)
+            {
+                if(ai < 24)
+                {
+                    v = ai;
+                    return true;
+                }
+                return ai < 28 && in.get(v, 1 << (ai - 24));
+            }
+
+            static double half(const unsigned int h)
+            {
+                const int e = (h >> 10) & 0x1f;
+                const double m = h & 0x3ff;
+                double d;
+                if(e == 0)
+                    d = std::ldexp(m, -24);
+                else if(e != 31)
+                    d = std::ldexp(m + 1024, e - 25);
+                else
+                    d = m == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+                return h & 0x8000 ? -d : d;
+            }
+
+            /* byte and text strings of indefinite length. text is joined into in.chunks */
+            static bool read_chunks(input &in, item &it, const unsigned int major)
+            {
+                in.chunks.clear();
+                for(;;)
+                {
+                    if(!in.has(1))
+                        return false;
+                    const unsigned int c = static_cast<unsigned char>(*in.p++);
+                    if(c == 0xff)
+                        break;
+                    uint64_t n;
+                    const char *s;
+                    if(c >> 5 != major || !argument(in, c & 0x1f, n) || !in.bytes(s, n))
+                        return false;
+                    if(major == 3)
+                        in.chunks.append(s, static_cast<size_t>(n));
+                }
+                if(major == 2)
+                {
+                    it.kind = item::other;
+                    return true;
+                }
+                it.kind = item::string;
+                it.s = in.chunks.data();
+                it.n = in.chunks.size();
+                it.transient = true;
+                return true;
+            }
+
+            static bool read(input &in, item &it)
+            {
+                it.transient = it.indefinite = false;
+                for(;;)
+                {
+                    if(!in.has(1))
+                        return false;
+                    const unsigned int c = static_cast<unsigned char>(*in.p++);
+                    const unsigned int major = c >> 5, ai = c & 0x1f;
+                    if(ai == 31)
+                    {
+                        switch(major)
+                        {
+                            case 2:
+                            case 3:
+                                return read_chunks(in, it, major);
+                            case 4:
+                            case 5:
+                                it.indefinite = true;
+                                return read_container(it, major == 4 ? item::array : item::map, 0);
+                            case 7:
+                                it.kind = item::stop;
+                                return true;
+                        }
+                        return false;
+                    }
+
+                    uint64_t v;
+                    if(!argument(in, ai, v))
+                        return false;
+                    switch(major)
+                    {
+                        case 0:
+                            return read_container(it, item::positive, v);
+                        case 1:
+                            if(v != std::numeric_limits<uint64_t>::max())
+                                return read_container(it, item::negative, v + 1);
+                            // -2^64 does not fit any integer
+                            it.kind = item::real;
+                            it.d = -18446744073709551616.0;
+                            return true;
+                        case 2:
+                            return read_other(in, it, v);
+                        case 3:
+                            return read_string(in, it, v);
+                        case 4:
+                            return read_container(it, item::array, v);
+                        case 5:
+                            return read_container(it, item::map, v);
+                        case 6:
+                            continue;   // tags are ignored and the tagged value is read
+                    }
+
+                    switch(ai)
+                    {
+                        case 20:
+                        case 21:
+                            it.kind = item::boolean;
+                            it.b = ai == 21;
+                            return true;
+                        case 22:
+                        case 23:    // undefined
+                            it.kind = item::nil;
+                            return true;
+                        case 25:
+                            it.kind = item::real;
+                            it.d = half(static_cast<unsigned int>(v));
+                            return true;
+                        case 26:
+                            {
+                                const uint32_t u = static_cast<uint32_t>(v);
+                                float f;
+                                memcpy(&f, &u, sizeof(f));
+                                it.kind = item::real;
+                                it.d = f;
+                            }
+                            return true;
+                        case 27:
+                            memcpy(&it.d, &v, sizeof(it.d));
+                            it.kind = item::real;
+                            return true;
+                    }
+                    it.kind = item::other;      // simple values
+                    return true;
+                }
+            }
+
+            static inline bool at_stop(input &in)
+            {
+                if(!in.has(1) || static_cast<unsigned char>(*in.p) != 0xff)
+                    return false;
+                ++in.p;
+                return true;
+            }
+        };
+
+        /* whether another element of the container it follows. left counts down a definite length */
+        template<typename Format>
+        inline bool more(input &in, const item &it, uint64_t &left)
+        {
+            if(it.indefinite)
+                return !Format::at_stop(in);
+            if(left == 0)
+                return false;
+            --left;
+            return true;
+        }
+
+        /* skips the elements of a container whose header has been read */
+        template<typename Format>
+        bool skip_contents(input &in, const item &it);
+
+        template<typename Format>
+        bool skip(input &in)
+        {
+            item it;
+            return Format::read(in, it) && it.kind != item::stop && skip_contents<Format>(in, it);
+        }
+
+        template<typename Format>
+        bool skip_contents(input &in, const item &it)
+        {
+            if(it.kind != item::array && it.kind != item::map)
+                return true;
+            for(uint64_t left = it.n; more<Format>(in, it, left); )
+            {
+                if(!skip<Format>(in) || (it.kind == item::map && !skip<Format>(in)))
+                    return false;
+            }
+            return true;
+        }
+
+        /* the value at the position is reported, not where reading stopped */
+        inline bool mismatch(input &in, const char *at, error_info *err)
+        {
+            in.p = at;
+            return _parser_funcs::set_error(err, error_info::type_mismatch);
+        }
+
+        template<typename Format, typename T, _json_values::type K = _type_checker::get_type<T>::value>
+        struct decoder
+        {
+            static bool decode(input &in, T &, error_info *err) { return mismatch(in, in.p, err); }
+        };
+
+        template<typename Format, typename T>
+        struct decoder<Format, T, _json_values::null_type>
+        {
+            static bool decode(input &in, T &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                if(it.kind != item::nil)
+                    return mismatch(in, at, err);
+                out = T();
+                return true;
+            }
+        };
+
+        template<typename Format, typename T>
+        struct decoder<Format, T, _json_values::boolean_type>
+        {
+            static bool decode(input &in, T &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                if(it.kind != item::boolean)
+                    return mismatch(in, at, err);
+                out = it.b;
+                return true;
+            }
+        };
+
+        template<typename Format, typename T>
+        struct number_decoder
+        {
+            static bool decode(input &in, T &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                bool ok;
+                switch(it.kind)
+                {
+                    case item::positive:
+                        ok = _parser_funcs::to_number(out, false, it.n);
+                        break;
+                    case item::negative:
+                        ok = _parser_funcs::to_number(out, true, it.n);
+                        break;
+                    case item::real:
+                        ok = _parser_funcs::to_number(out, it.d);
+                        break;
+                    default:
+                        return mismatch(in, at, err);
+                }
+                if(ok)
+                    return true;
+                in.p = at;
+                return _parser_funcs::set_error(err, error_info::out_of_range);
+            }
+        };
+
+        template<typename Format, typename T>
+        struct decoder<Format, T, _json_values::int_type> : public number_decoder<Format, T> { };
+
+        template<typename Format, typename T>
+        struct decoder<Format, T, _json_values::double_type> : public number_decoder<Format, T> { };
+
+        /* views refer to the input. strings sent in pieces can not be referred to */
+        template<typename Format, typename T>
+        struct decoder<Format, T, _json_values::string_type>
+        {
+            static bool decode(input &in, T &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                if(it.kind != item::string || it.transient)
+                    return mismatch(in, at, err);
+                out = T(it.s, static_cast<size_t>(it.n));
+                return true;
+            }
+        };
+
+        template<typename Format>
+        struct decoder<Format, std::string, _json_values::string_type>
+        {
+            static bool decode(input &in, std::string &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                if(it.kind != item::string)
+                    return mismatch(in, at, err);
+                out.assign(it.s, static_cast<size_t>(it.n));
+                return true;
+            }
+        };
+
+        /* elements already in the vector are overwritten so that their buffers are reused */
+        template<typename Format, typename T>
+        struct decoder<Format, T, _json_values::array_type>
+        {
+            static bool decode(input &in, T &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                if(it.kind != item::array)
+                    return mismatch(in, at, err);
+
+                size_t items = 0;
+                for(uint64_t left = it.n; more<Format>(in, it, left); ++items)
+                {
+                    if(items == out.size())
+                        out.push_back(typename T::value_type());
+                    if(!decoder<Format, typename T::value_type>::decode(in, out[items], err))
+                    {
+                        if(err)
+                            err->_prepend(items);
+                        return false;
+                    }
+                }
+                if(items < out.size())
+                    out.resize(items);
+                return true;
+            }
+        };
+
+        /* the elements of std::vector<bool> are decoded into a bool and stored by value */
+        template<typename Format, typename A>
+        struct decoder<Format, std::vector<bool, A>, _json_values::array_type>
+        {
+            static bool decode(input &in, std::vector<bool, A> &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                if(it.kind != item::array)
+                    return mismatch(in, at, err);
+
+                size_t items = 0;
+                for(uint64_t left = it.n; more<Format>(in, it, left); ++items)
+                {
+                    bool b = false;
+                    if(!decoder<Format, bool>::decode(in, b, err))
+                    {
+                        if(err)
+                            err->_prepend(items);
+                        return false;
+                    }
+                    if(items == out.size())
+                        out.push_back(b);
+                    else
+                        out[items] = b;
+                }
+                if(items < out.size())
+                    out.resize(items);
+                return true;
+            }
+        };
+
+        template<typename Format>
+        struct field_decoder
+        {
+            input &in;
+            error_info *err;
+
+            field_decoder(input &in, error_info *err) : in(in), err(err) { }
+
+            template<typename F>
+            inline bool operator()(F *, typename F::owner_type &out)
+            {
+                return decoder<Format, typename F::value_type>::decode(in, F::get(out), err);
+            }
+        };
+
+        /* keys are looked up by the perfect hash of the member table. other keys and their values are skipped */
+        template<typename Format, typename T>
+        struct decoder<Format, T, _json_values::object_type>
+        {
+            static bool decode(input &in, T &out, error_info *err)
+            {
+                const char *at = in.p;
+                item it;
+                if(!Format::read(in, it))
+                    return false;
+                if(it.kind != item::map)
+                    return mismatch(in, at, err);
+
+                const _pos_list *list = _members<T>::get();
+                field_decoder<Format> visit(in, err);
+                std::string copy;
+                _seen_members seen;
+                seen.clear(list->count);
+                for(uint64_t left = it.n; more<Format>(in, it, left); )
+                {
+                    item key;
+                    if(!Format::read(in, key) || key.kind == item::stop)
+                        return false;
+                    if(key.kind != item::string)
+                    {
+                        if(!skip_contents<Format>(in, key) || !skip<Format>(in))
+                            return false;
+                        continue;
+                    }
+                    if(key.transient)
+                    {
+                        // the value may overwrite the chunks
+                        copy.assign(key.s, static_cast<size_t>(key.n));
+                        key.s = copy.data();
+                    }
+
+                    const _member_info *mi = list->find(key.s, static_cast<size_t>(key.n));
+                    const int i = mi ? static_cast<int>(mi - list->begin()) : 0;
+                    if(mi ? _parser_funcs::member_dispatch<T, 0, _members<T>::count>::apply(out, i, visit) : skip<Format>(in))
+                    {
+                        if(mi)
+                            seen.add(i);
+                        continue;
+                    }
+                    if(err)
+                        err->_prepend(key.s, static_cast<size_t>(key.n));
+                    return false;
+                }
+                return _parser_funcs::finish_object(&out, list, seen, 0, err);
+            }
+        };
+
+        template<typename T>
+        inline bool is_negative(const T v, typename _type_checker::_enable<std::numeric_limits<T>::is_signed>::type* = 0)
+        {
+            return v < 0;
+        }
+
+        template<typename T>
+        inline bool is_negative(const T, typename _type_checker::_enable<!std::numeric_limits<T>::is_signed>::type* = 0)
+        {
+            return false;
+        }
+
+        template<typename Format, typename T, _json_values::type K = _type_checker::get_type<T>::value>
+        struct encoder
+        {
+            static void encode(std::string &, const T &) { throw __exception("error invalid member type"); }
+        };
+
+        template<typename Format, typename T>
+        struct encoder<Format, T, _json_values::null_type>
+        {
+            static void encode(std::string &b, const T &) { Format::put_nil(b); }
+        };
+
+        template<typename Format, typename T>
+        struct encoder<Format, T, _json_values::boolean_type>
+        {
+            static void encode(std::string &b, const T &v) { Format::put_bool(b, v); }
+        };
+
+        template<typename Format, typename T>
+        struct encoder<Format, T, _json_values::int_type>
+        {
+            static void encode(std::string &b, const T &v)
+            {
+                if(is_negative(v))
+                    Format::put_negative(b, 0 - static_cast<uint64_t>(static_cast<int64_t>(v)));
+                else
+                    Format::put_unsigned(b, static_cast<uint64_t>(v));
+            }
+        };
+
+        template<typename Format, typename T>
+        struct encoder<Format, T, _json_values::double_type>
+        {
+            static void encode(std::string &b, const T &v)
+            {
+                if(sizeof(T) == sizeof(float))
+                    Format::put_float(b, static_cast<float>(v));
+                else
+                    Format::put_double(b, static_cast<double>(v));
+            }
+        };
+
+        template<typename Format, typename T>
+        struct encoder<Format, T, _json_values::string_type>
+        {
+            static void encode(std::string &b, const T &v) { Format::put_string(b, v.data(), v.size()); }
+        };
+
+        template<typename Format, typename T>
+        struct encoder<Format, T, _json_values::array_type>
+        {
+            static void encode(std::string &b, const T &v)
+            {
+                Format::put_array(b, v.size());
+                for(typename T::const_iterator it = v.begin(); it != v.end(); ++it)
+                    encoder<Format, typename T::value_type>::encode(b, *it);
+            }
+        };
+
+        template<typename Format>
+        struct field_encoder
+        {
+            std::string &b;
+
+            field_encoder(std::string &b) : b(b) { }
+
+            template<typename F>
+            inline bool operator()(F *, const typename F::owner_type &obj)
+            {
+                encoder<Format, typename F::value_type>::encode(b, F::get(obj));
+                return true;
+            }
+        };
+
+        /* members are written in declaration order, with the names of the member table */
+        template<typename Format, typename T>
+        struct encoder<Format, T, _json_values::object_type>
+        {
+            static void encode(std::string &b, const T &v)
+            {
+                const _pos_list *list = _members<T>::get();
+                Format::put_map(b, list->count);
+                field_encoder<Format> visit(b);
+                for(const _member_info *mi = list->begin(); mi != list->end(); ++mi)
+                {
+                    Format::put_string(b, mi->name, mi->name_len);
+                    _parser_funcs::member_dispatch<T, 0, _members<T>::count>::apply(v, static_cast<int>(mi - list->begin()), visit);
+                }
+            }
+        };
+    }
+
+    /* maps one binary message to a def'd struct. use msgpack_reader or cbor_reader */
+    template<typename Format>
+    class _binary_reader
     {
     private:
-        const char *filename;
+        size_t used;
     public:
-        reader() { }
-        reader(const char *filename) : filename(filename) { }
-        ~reader() { }
+        _binary_reader() : used(0) { }
 
-        bool load(const char *filename)
+        /* maps the message at the start of data. failures are reported in err instead of thrown, in the
+           same way as reader::parse_into. bytes after the message are left for the next call */
+        template<typename T>
+        bool parse_into(T &result, const char *data, const size_t len, error_info &err) NANOJSON_NOEXCEPT
         {
-            this->filename = filename;
-            return false;
+            err.clear();
+            used = 0;
+            try
+            {
+                _binary_funcs::input in(data, len);
+                const bool ok = _binary_funcs::decoder<Format, T>::decode(in, result, &err);
+                used = in.p - data;
+                if(ok)
+                    return true;
+                err.offset = used;
+                if(err.code == error_info::ok)
+                    err.code = error_info::syntax_error;
+                else if(err.code == error_info::type_mismatch && err.path.empty())
+                    err.code = error_info::not_object;
+                return false;
+            }
+            catch(...)
+            {
+                err.code = _exception_code();
+                return false;
+            }
         }
 
         template<typename T>
-        T parse(const char *str, const size_t len)
+        void parse_into(T &result, const char *data, const size_t len)
         {
-            T result;
-            picojson::value val;
-            std::string err;
-            picojson::parse(val, str, str + len, &err);
-
-            if(!err.empty())
-                throw __exception("json parse error.");
-
-            if(!val.is<picojson::object>())
+            error_info err;
+            if(parse_into(result, data, len, err))
+                return;
+            if(err.code == error_info::not_object)
                 throw __exception("root element must be object.");
+            throw __exception((std::string(err.message()) + ": " + err.path).c_str());
+        }
 
-            _parser_funcs::parse<T>(result, val.get<picojson::object>());
-
+        template<typename T>
+        T parse(const char *data, const size_t len)
+        {
+            T result;
+            parse_into(result, data, len);
             return result;
         }
 
         template<typename T>
-        inline T parse(const char *str) { return parse<T>(str, strlen(str)); }
+        inline T parse(const std::string &data) { return parse<T>(data.data(), data.size()); }
+
+        /* size of the last message, so that concatenated messages can be read one after another */
+        inline size_t consumed() const { return used; }
+    };
+
+    /* serializes def'd structs into a binary format. use msgpack_writer or cbor_writer */
+    template<typename Format>
+    class _binary_writer
+    {
+    private:
+        std::string buffer;
+    public:
+        _binary_writer() { }
 
+        /* appends obj as one message */
         template<typename T>
-        inline T parse()
+        inline void write(const T &obj) { _binary_funcs::encoder<Format, T>::encode(buffer, obj); }
+
+        inline void clear() { buffer.clear(); }
+        inline const char *data() const { return buffer.data(); }
+        inline size_t size() const { return buffer.size(); }
+        inline const std::string &str() const { return buffer; }
+    private:
+        _binary_writer(const _binary_writer &);
+        _binary_writer &operator=(const _binary_writer &);
+    };
+
+    typedef _binary_reader<_binary_funcs::msgpack> msgpack_reader;
+    typedef _binary_writer<_binary_funcs::msgpack> msgpack_writer;
+    typedef _binary_reader<_binary_funcs::cbor> cbor_reader;
+    typedef _binary_writer<_binary_funcs::cbor> cbor_writer;
+}
+#if __cplusplus >= 201103L
+namespace std
+{
+    template<>
+    struct hash<nanojson::str_ref>
+    {
+        size_t operator()(const nanojson::str_ref &r) const
         {
-            std::ifstream ifs(filename, std::ios::in);
-            assert(ifs);
-            std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-            return parse<T>(str.c_str(), str.size());
+            // FNV-1a
+            size_t h = static_cast<size_t>(14695981039346656037ULL);
+            for(const char *p = r.begin(); p != r.end(); ++p)
+                h = (h ^ static_cast<unsigned char>(*p)) * static_cast<size_t>(1099511628211ULL);
+            return h;
         }
     };
 }
+#endif
+
 #define def(T, NAME)    \
-    struct type_ ## NAME : public nanojson::json_element<type_ ## NAME, T> {  \
-        static const char *_get_name() { return # NAME; }    \
-        static void _register(nanojson::_member_info *_mi)  \
+    T NAME;     \
+    NANOJSON_MEMBER(T, NAME)
+
+/* declares an existing member of the type given to NANOJSON_DESCRIBE */
+#define NANOJSON_MEMBER(T, NAME)    \
+    enum { _index_ ## NAME = sizeof(_count_members(static_cast<nanojson::_type_checker::_rank<NANOJSON_MAX_MEMBERS> *>(0))) - 1 };  \
+    static nanojson::_type_checker::_counter<_index_ ## NAME + 1> _count_members(nanojson::_type_checker::_rank<_index_ ## NAME + 1> *);   \
+    static nanojson::_field<self_type, T, &self_type::NAME> *_member(   \
+        nanojson::_type_checker::_index<_index_ ## NAME> *, nanojson::_member_info *_mi = 0)  \
+    {   \
+        if(_mi)     \
+            nanojson::_field<self_type, T, &self_type::NAME>::fill(*_mi, # NAME, sizeof(# NAME) - 1, offsetof(self_type, NAME)); \
+        return 0;   \
+    }
+
+/* describes the members of C outside of C, which then needs neither to derive from object nor to be
+   changed at all. use at global scope:
+   NANOJSON_DESCRIBE(Point) NANOJSON_MEMBER(int, x); NANOJSON_MEMBER(int, y); NANOJSON_DESCRIBE_END */
+#define NANOJSON_DESCRIBE(C)    \
+    namespace nanojson  \
+    {   \
+        template<>  \
+        struct _describe<C>     \
         {   \
-            self_type::_register(   \
-                _mi, offsetof(self_type, NAME),         \
-                nanojson::_type_checker::get_type<T>::value     \
-            );      \
-        } \
-    } type_ ## NAME;      \
-    T NAME;
+            typedef _describe<C> type;  \
+            typedef C self_type;    \
+            static _type_checker::_counter<0> _count_members(_type_checker::_rank<0> *);
+
+#define NANOJSON_DESCRIBE_END   \
+        };  \
+    }
 #undef __exception
 
 #endif
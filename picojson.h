@@ -36,13 +36,28 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <clocale>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <new>
 #include <string>
 #include <vector>
+#include <stdint.h>
+
+#ifndef PICOJSON_NO_SIMD
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PICOJSON_USE_SSE2
+    #include <emmintrin.h>
+  #endif
+  #if defined(PICOJSON_USE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define PICOJSON_USE_AVX2
+    #include <immintrin.h>
+  #endif
+#endif
 
 #ifdef _MSC_VER
+    #include <intrin.h>
     #define SNPRINTF _snprintf_s
     #pragma warning(push)
     #pragma warning(disable : 4244) // conversion from int to char
@@ -62,11 +77,97 @@ namespace picojson {
   };
   
   struct null {};
-  
+
+  /*
+   * monotonic allocator for the std::string/array/object nodes of a document.
+   * the characters, elements and map entries those nodes own still come from
+   * std::allocator, since the container types are fixed. clear() rewinds to
+   * the first block without freeing, so a document built again in the same
+   * arena does not call malloc for its nodes. values built in the arena must
+   * be destroyed before clear() and before the arena itself.
+   */
+  class arena {
+    struct block {
+      block* next;
+      size_t size;
+    };
+    enum { align = 16, max_block_size = 1 << 20 };
+    block* head_;    // oldest block
+    block* current_; // block cur_ points into
+    char* cur_;
+    char* end_;
+    size_t next_size_;
+    void use(block* b) {
+      current_ = b;
+      cur_ = (char*)b + align;
+      end_ = cur_ + b->size;
+    }
+    // inserts a new block of at least n bytes in front of next
+    block* add_block(size_t n, block* next) {
+      size_t size = n > next_size_ ? n : next_size_;
+      block* b = (block*)std::malloc(align + size);
+      if (b == NULL) {
+        throw std::bad_alloc();
+      }
+      b->next = next;
+      b->size = size;
+      if (current_ != NULL) {
+        current_->next = b;
+      } else {
+        head_ = b;
+      }
+      if (next_size_ < max_block_size) {
+        next_size_ *= 2;
+      }
+      return b;
+    }
+  public:
+    explicit arena(size_t initial_size = 4096) : head_(NULL), current_(NULL), cur_(NULL), end_(NULL), next_size_(initial_size) {}
+    ~arena() {
+      release();
+    }
+    void clear() {
+      if (head_ != NULL) {
+        use(head_);
+      }
+    }
+    void release() {
+      while (head_ != NULL) {
+        block* next = head_->next;
+        std::free(head_);
+        head_ = next;
+      }
+      current_ = NULL;
+      cur_ = end_ = NULL;
+    }
+    void* allocate(size_t n) {
+      n = (n + align - 1) & ~(size_t)(align - 1);
+      if ((size_t)(end_ - cur_) < n) {
+        // blocks kept by clear() are used in order, unless one is too small for n
+        block* next = current_ != NULL ? current_->next : head_;
+        use(next != NULL && next->size >= n ? next : add_block(n, next));
+      }
+      void* p = cur_;
+      cur_ += n;
+      return p;
+    }
+  private:
+    arena(const arena&);
+    arena& operator=(const arena&);
+  };
+
+#ifdef PICOJSON_FLAT_OBJECT
+  class flat_object;
+#endif
+
   class value {
   public:
     typedef std::vector<value> array;
+#ifdef PICOJSON_FLAT_OBJECT
+    typedef flat_object object;
+#else
     typedef std::map<std::string, value> object;
+#endif
     union _storage {
       bool boolean_;
       double number_;
@@ -76,10 +177,12 @@ namespace picojson {
     };
   protected:
     int type_;
+    bool arena_; // u_ points into an arena; only the destructor of the node is called
     _storage u_;
   public:
     value();
     value(int type, bool);
+    value(int type, arena* a);
     explicit value(bool b);
     explicit value(double n);
     explicit value(const std::string& s);
@@ -106,12 +209,157 @@ namespace picojson {
     template <typename T> value(const T*); // intentionally defined to block implicit conversion of pointer to bool
   };
   
+#ifdef PICOJSON_FLAT_OBJECT
+  /*
+   * object kept as a vector of members in insertion order. small objects are
+   * searched linearly, larger ones through an open addressing hash index.
+   */
+  class flat_object {
+  public:
+    typedef std::string key_type;
+    typedef value mapped_type;
+    typedef std::pair<std::string, value> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+    typedef std::vector<value_type>::size_type size_type;
+  private:
+    enum { linear_limit = 8 };
+    std::vector<value_type> items_;
+    std::vector<size_t> index_; // item index + 1 for each slot, 0 if empty. unused while small
+    static size_t hash(const std::string& key) {
+      size_t h = 2166136261u;
+      for (std::string::const_iterator i = key.begin(); i != key.end(); ++i) {
+        h = (h ^ (unsigned char)*i) * 16777619u;
+      }
+      return h;
+    }
+    size_t lookup(const std::string& key) const {
+      if (index_.empty()) {
+        for (size_t i = 0; i < items_.size(); ++i) {
+          if (items_[i].first == key) {
+            return i;
+          }
+        }
+        return items_.size();
+      }
+      const size_t mask = index_.size() - 1;
+      for (size_t slot = hash(key) & mask; index_[slot] != 0; slot = (slot + 1) & mask) {
+        if (items_[index_[slot] - 1].first == key) {
+          return index_[slot] - 1;
+        }
+      }
+      return items_.size();
+    }
+    void insert_index(size_t i) {
+      const size_t mask = index_.size() - 1;
+      size_t slot = hash(items_[i].first) & mask;
+      while (index_[slot] != 0) {
+        slot = (slot + 1) & mask;
+      }
+      index_[slot] = i + 1;
+    }
+    void rebuild_index() {
+      index_.clear();
+      if (items_.size() <= linear_limit) {
+        return;
+      }
+      size_t size = 16;
+      while (size < items_.size() * 2) {
+        size *= 2;
+      }
+      index_.assign(size, 0);
+      for (size_t i = 0; i < items_.size(); ++i) {
+        insert_index(i);
+      }
+    }
+    iterator append(const std::string& key) {
+      if (items_.size() == items_.capacity()) {
+        // grow by swapping, copying a value would deep copy its children
+        std::vector<value_type> grown;
+        grown.reserve(items_.empty() ? 4 : items_.size() * 2);
+        grown.resize(items_.size());
+        for (size_t i = 0; i < items_.size(); ++i) {
+          grown[i].first.swap(items_[i].first);
+          grown[i].second.swap(items_[i].second);
+        }
+        items_.swap(grown);
+      }
+      items_.push_back(value_type(key, value()));
+      if (index_.empty() ? items_.size() > linear_limit : items_.size() * 2 > index_.size()) {
+        rebuild_index();
+      } else if (! index_.empty()) {
+        insert_index(items_.size() - 1);
+      }
+      return items_.end() - 1;
+    }
+  public:
+    flat_object() {}
+    iterator begin() { return items_.begin(); }
+    iterator end() { return items_.end(); }
+    const_iterator begin() const { return items_.begin(); }
+    const_iterator end() const { return items_.end(); }
+    size_type size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+    void clear() {
+      items_.clear();
+      index_.clear();
+    }
+    void swap(flat_object& x) {
+      items_.swap(x.items_);
+      index_.swap(x.index_);
+    }
+    iterator find(const std::string& key) { return items_.begin() + lookup(key); }
+    const_iterator find(const std::string& key) const { return items_.begin() + lookup(key); }
+    size_type count(const std::string& key) const { return lookup(key) != items_.size() ? 1 : 0; }
+    value& operator[](const std::string& key) {
+      const size_t i = lookup(key);
+      return i != items_.size() ? items_[i].second : append(key)->second;
+    }
+    std::pair<iterator, bool> insert(const value_type& x) {
+      const size_t i = lookup(x.first);
+      if (i != items_.size()) {
+        return std::make_pair(items_.begin() + i, false);
+      }
+      iterator it = append(x.first);
+      it->second = x.second;
+      return std::make_pair(it, true);
+    }
+    size_type erase(const std::string& key) {
+      const size_t i = lookup(key);
+      if (i == items_.size()) {
+        return 0;
+      }
+      items_.erase(items_.begin() + i);
+      rebuild_index();
+      return 1;
+    }
+  };
+
+  inline bool operator==(const value& x, const value& y);
+
+  // member order does not matter, as for std::map
+  inline bool operator==(const flat_object& x, const flat_object& y) {
+    if (x.size() != y.size()) {
+      return false;
+    }
+    for (flat_object::const_iterator i = x.begin(); i != x.end(); ++i) {
+      flat_object::const_iterator j = y.find(i->first);
+      if (j == y.end() || ! (i->second == j->second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+#endif
+
   typedef value::array array;
   typedef value::object object;
   
-  inline value::value() : type_(null_type) {}
+  inline value::value() : type_(null_type), arena_(false) {
+    u_.object_ = NULL;
+  }
   
-  inline value::value(int type, bool) : type_(type) {
+  inline value::value(int type, bool) : type_(type), arena_(false) {
     switch (type) {
 #define INIT(p, v) case p##type: u_.p = v; break
       INIT(boolean_, false);
@@ -124,37 +372,60 @@ namespace picojson {
     }
   }
   
-  inline value::value(bool b) : type_(boolean_type) {
+  inline value::value(int type, arena* a) : type_(type), arena_(a != NULL) {
+    switch (type) {
+#define INIT(p, v) case p##type: u_.p = v; break
+#define NEW(T) (a != NULL ? new (a->allocate(sizeof(T))) T() : new T())
+      INIT(boolean_, false);
+      INIT(number_, 0.0);
+      INIT(string_, NEW(std::string));
+      INIT(array_, NEW(array));
+      INIT(object_, NEW(object));
+#undef NEW
+#undef INIT
+    default: break;
+    }
+  }
+  
+  inline value::value(bool b) : type_(boolean_type), arena_(false) {
     u_.boolean_ = b;
   }
   
-  inline value::value(double n) : type_(number_type) {
+  inline value::value(double n) : type_(number_type), arena_(false) {
     u_.number_ = n;
   }
   
-  inline value::value(const std::string& s) : type_(string_type) {
+  inline value::value(const std::string& s) : type_(string_type), arena_(false) {
     u_.string_ = new std::string(s);
   }
   
-  inline value::value(const array& a) : type_(array_type) {
+  inline value::value(const array& a) : type_(array_type), arena_(false) {
     u_.array_ = new array(a);
   }
   
-  inline value::value(const object& o) : type_(object_type) {
+  inline value::value(const object& o) : type_(object_type), arena_(false) {
     u_.object_ = new object(o);
   }
   
-  inline value::value(const char* s) : type_(string_type) {
+  inline value::value(const char* s) : type_(string_type), arena_(false) {
     u_.string_ = new std::string(s);
   }
   
-  inline value::value(const char* s, size_t len) : type_(string_type) {
+  inline value::value(const char* s, size_t len) : type_(string_type), arena_(false) {
     u_.string_ = new std::string(s, len);
   }
   
+  template <typename T> inline void _destroy(T* p, bool in_arena) {
+    if (in_arena) {
+      p->~T();
+    } else {
+      delete p;
+    }
+  }
+  
   inline value::~value() {
     switch (type_) {
-#define DEINIT(p) case p##type: delete u_.p; break
+#define DEINIT(p) case p##type: _destroy(u_.p, arena_); break
       DEINIT(string_);
       DEINIT(array_);
       DEINIT(object_);
@@ -163,7 +434,7 @@ namespace picojson {
     }
   }
   
-  inline value::value(const value& x) : type_(x.type_) {
+  inline value::value(const value& x) : type_(x.type_), arena_(false) {
     switch (type_) {
 #define INIT(p, v) case p##type: u_.p = v; break
       INIT(string_, new std::string(*x.u_.string_));
@@ -186,6 +457,7 @@ namespace picojson {
   
   inline void value::swap(value& x) {
     std::swap(type_, x.type_);
+    std::swap(arena_, x.arena_);
     std::swap(u_, x.u_);
   }
   
@@ -417,6 +689,375 @@ namespace picojson {
       return true;
     }
   };
+
+  /*
+   * block scanners for contiguous input. each returns the first position in
+   * [p, end) which is not whitespace / which ends a plain run of string
+   * characters ('"', '\\' or a control character), or end.
+   */
+  typedef const char* (*_scan_func)(const char*, const char*);
+
+  inline bool _is_ws(int ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+  }
+
+  inline bool _is_string_special(int ch) {
+    return ch == '"' || ch == '\\' || (unsigned char)ch < 0x20;
+  }
+
+  inline const char* _skip_ws_scalar(const char* p, const char* end) {
+    while (p != end && _is_ws(*p)) {
+      ++p;
+    }
+    return p;
+  }
+
+  inline const char* _scan_string_scalar(const char* p, const char* end) {
+    while (p != end && ! _is_string_special(*p)) {
+      ++p;
+    }
+    return p;
+  }
+
+  inline int _first_bit(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (int)idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+#ifdef PICOJSON_USE_SSE2
+  inline const char* _skip_ws_sse2(const char* p, const char* end) {
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'),
+      lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    for (; end - p >= 16; p += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)p);
+      __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+      unsigned int mask = ~(unsigned int)_mm_movemask_epi8(ws) & 0xffff;
+      if (mask != 0) {
+        return p + _first_bit(mask);
+      }
+    }
+    return _skip_ws_scalar(p, end);
+  }
+
+  inline const char* _scan_string_sse2(const char* p, const char* end) {
+    const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\'), ctrl = _mm_set1_epi8(0x1f);
+    for (; end - p >= 16; p += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)p);
+      __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+      unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+      if (mask != 0) {
+        return p + _first_bit(mask);
+      }
+    }
+    return _scan_string_scalar(p, end);
+  }
+#endif
+
+#ifdef PICOJSON_USE_AVX2
+  __attribute__((target("avx2"))) inline const char* _skip_ws_avx2(const char* p, const char* end) {
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'),
+      lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    for (; end - p >= 32; p += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)p);
+      __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                                   _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+      unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(ws);
+      if (mask != 0) {
+        return p + _first_bit(mask);
+      }
+    }
+    return _skip_ws_sse2(p, end);
+  }
+
+  __attribute__((target("avx2"))) inline const char* _scan_string_avx2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('"'), bslash = _mm256_set1_epi8('\\'), ctrl = _mm256_set1_epi8(0x1f);
+    for (; end - p >= 32; p += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)p);
+      __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+                                    _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl));
+      unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+      if (mask != 0) {
+        return p + _first_bit(mask);
+      }
+    }
+    return _scan_string_sse2(p, end);
+  }
+#endif
+
+  /*
+   * block classifiers for the structural index. each sets bit i of the masks
+   * when byte i of the 64 byte block at p is a quote, a backslash, one of
+   * {}[]:, or a control character.
+   */
+  struct _block_masks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t ctrl;
+  };
+  typedef void (*_classify_func)(const char*, _block_masks&);
+
+  inline void _classify_scalar(const char* p, _block_masks& m) {
+    m.quote = m.backslash = m.op = m.ctrl = 0;
+    for (int i = 0; i < 64; ++i) {
+      const uint64_t bit = (uint64_t)1 << i;
+      switch (p[i]) {
+      case '"':
+        m.quote |= bit;
+        break;
+      case '\\':
+        m.backslash |= bit;
+        break;
+      case '{': case '}': case '[': case ']': case ':': case ',':
+        m.op |= bit;
+        break;
+      default:
+        if ((unsigned char)p[i] < 0x20) {
+          m.ctrl |= bit;
+        }
+        break;
+      }
+    }
+  }
+
+#ifdef PICOJSON_USE_SSE2
+  inline void _classify_sse2(const char* p, _block_masks& m) {
+    // '{' and '[' (and '}' and ']') only differ in bit 5
+    const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\'), ctrl = _mm_set1_epi8(0x1f),
+      fold = _mm_set1_epi8(0x20), open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}'),
+      colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(',');
+    m.quote = m.backslash = m.op = m.ctrl = 0;
+    for (int i = 0; i < 4; ++i) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(p + i * 16));
+      __m128i f = _mm_or_si128(v, fold);
+      __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(f, open), _mm_cmpeq_epi8(f, close)),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+      m.quote |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << (i * 16);
+      m.backslash |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bslash)) << (i * 16);
+      m.op |= (uint64_t)(unsigned int)_mm_movemask_epi8(op) << (i * 16);
+      m.ctrl |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl)) << (i * 16);
+    }
+  }
+#endif
+
+#ifdef PICOJSON_USE_AVX2
+  __attribute__((target("avx2"))) inline void _classify_avx2(const char* p, _block_masks& m) {
+    const __m256i quote = _mm256_set1_epi8('"'), bslash = _mm256_set1_epi8('\\'), ctrl = _mm256_set1_epi8(0x1f),
+      fold = _mm256_set1_epi8(0x20), open = _mm256_set1_epi8('{'), close = _mm256_set1_epi8('}'),
+      colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(',');
+    m.quote = m.backslash = m.op = m.ctrl = 0;
+    for (int i = 0; i < 2; ++i) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(p + i * 32));
+      __m256i f = _mm256_or_si256(v, fold);
+      __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(f, open), _mm256_cmpeq_epi8(f, close)),
+                                   _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+      m.quote |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << (i * 32);
+      m.backslash |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bslash)) << (i * 32);
+      m.op |= (uint64_t)(unsigned int)_mm256_movemask_epi8(op) << (i * 32);
+      m.ctrl |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl)) << (i * 32);
+    }
+  }
+#endif
+
+  /* picks the widest scanners the running cpu supports. this happens during static initialization so that
+     threads started later never race on the pointers; anything parsed before that resolves them on first use */
+  template <typename T> struct _scanners {
+    struct initializer {
+      initializer() { select(); }
+    };
+    static initializer init;
+    static _scan_func skip_ws;
+    static _scan_func scan_string;
+    static _classify_func classify;
+    static void select() {
+#if defined(PICOJSON_USE_AVX2)
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) {
+        skip_ws = _skip_ws_avx2;
+        scan_string = _scan_string_avx2;
+        classify = _classify_avx2;
+        return;
+      }
+#endif
+#if defined(PICOJSON_USE_SSE2)
+      skip_ws = _skip_ws_sse2;
+      scan_string = _scan_string_sse2;
+      classify = _classify_sse2;
+#else
+      skip_ws = _skip_ws_scalar;
+      scan_string = _scan_string_scalar;
+      classify = _classify_scalar;
+#endif
+    }
+    static const char* resolve_skip_ws(const char* p, const char* end) {
+      (void)&init;
+      select();
+      return skip_ws(p, end);
+    }
+    static const char* resolve_scan_string(const char* p, const char* end) {
+      select();
+      return scan_string(p, end);
+    }
+    static void resolve_classify(const char* p, _block_masks& m) {
+      select();
+      classify(p, m);
+    }
+  };
+  template <typename T> _scan_func _scanners<T>::skip_ws = _scanners<T>::resolve_skip_ws;
+  template <typename T> _scan_func _scanners<T>::scan_string = _scanners<T>::resolve_scan_string;
+  template <typename T> _classify_func _scanners<T>::classify = _scanners<T>::resolve_classify;
+  template <typename T> typename _scanners<T>::initializer _scanners<T>::init;
+
+  inline int _first_bit64(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned int lo = (unsigned int)mask;
+    return lo != 0 ? _first_bit(lo) : 32 + _first_bit((unsigned int)(mask >> 32));
+#else
+    return __builtin_ctzll(mask);
+#endif
+  }
+
+  /*
+   * stage 1 of the structural index: the offsets of {}[]:, outside strings
+   * and of the quotes which open a string, in input order. fails when a
+   * string is not terminated or holds a raw control character, or when the
+   * input does not fit in 32 bit offsets. escapes tells whether there is any
+   * backslash, so that strings need not be searched for one.
+   */
+  inline bool _build_structural_index(const char* p, size_t len, std::vector<uint32_t>& out, bool* escapes = NULL) {
+    out.clear();
+    if (len >= 0xffffffffu) {
+      return false;
+    }
+    out.resize(len / 8 + 64);
+    size_t used = 0;
+    uint64_t carry_escape = 0, in_string_carry = 0, bad = 0, backslashes = 0;
+    char tail[64];
+
+    for (size_t base = 0; base < len; base += 64) {
+      const char* block = p + base;
+      if (len - base < 64) {
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, block, len - base);
+        block = tail;
+      }
+      _block_masks m;
+      _scanners<bool>::classify(block, m);
+
+      // a backslash escapes the next byte, unless it is escaped itself
+      backslashes |= m.backslash;
+      uint64_t escaped = carry_escape;
+      carry_escape = 0;
+      for (uint64_t b = m.backslash & ~escaped; b != 0; ) {
+        uint64_t bit = b & (0 - b);
+        if (bit == (uint64_t)1 << 63) {
+          carry_escape = 1;
+          break;
+        }
+        escaped |= bit << 1;
+        b &= ~(bit | (bit << 1));
+      }
+
+      // bit i of in_string is set from an opening quote up to the byte before the closing one
+      uint64_t quotes = m.quote & ~escaped;
+      uint64_t in_string = quotes;
+      in_string ^= in_string << 1;
+      in_string ^= in_string << 2;
+      in_string ^= in_string << 4;
+      in_string ^= in_string << 8;
+      in_string ^= in_string << 16;
+      in_string ^= in_string << 32;
+      in_string ^= in_string_carry;
+      in_string_carry = (uint64_t)0 - (in_string >> 63);
+
+      bad |= m.ctrl & in_string;
+      uint64_t structural = (m.op & ~in_string) | (quotes & in_string);
+
+      if (out.size() - used < 64) {
+        out.resize(out.size() * 2);
+      }
+      uint32_t* dst = &out[used];
+      for (; structural != 0; structural &= structural - 1) {
+        *dst++ = (uint32_t)(base + _first_bit64(structural));
+      }
+      used = dst - &out[0];
+    }
+
+    out.resize(used);
+    if (escapes != NULL) {
+      *escapes = backslashes != 0;
+    }
+    return bad == 0 && in_string_carry == 0;
+  }
+
+  /* contiguous input, scanned in blocks. the line number is only computed on demand */
+  template <> class input<const char*> {
+  protected:
+    const char* first_;
+    const char* cur_;
+    const char* end_;
+    bool eof_;
+  public:
+    input(const char* first, const char* last) : first_(first), cur_(first), end_(last), eof_(false) {}
+    int getc() {
+      if (cur_ == end_) {
+        eof_ = true;
+        return -1;
+      }
+      eof_ = false;
+      return *cur_++ & 0xff;
+    }
+    void ungetc() {
+      if (! eof_) {
+        --cur_;
+      }
+      eof_ = false;
+    }
+    const char* cur() const { return cur_; }
+    const char* end() const { return end_; }
+    void seek(const char* p) {
+      cur_ = p;
+      eof_ = false;
+    }
+    int line() const {
+      return 1 + (int)std::count(first_, cur_, '\n');
+    }
+    void skip_ws() {
+      eof_ = false;
+      if (cur_ != end_ && _is_ws(*cur_)) {
+        ++cur_;
+        if (cur_ != end_ && _is_ws(*cur_)) {
+          cur_ = _scanners<bool>::skip_ws(cur_ + 1, end_);
+        }
+      }
+    }
+    bool expect(int expect) {
+      skip_ws();
+      if (cur_ == end_ || (*cur_ & 0xff) != expect) {
+        return false;
+      }
+      ++cur_;
+      return true;
+    }
+    bool match(const std::string& pattern) {
+      for (std::string::const_iterator pi(pattern.begin());
+	   pi != pattern.end();
+	   ++pi) {
+	if (getc() != *pi) {
+	  ungetc();
+	  return false;
+	}
+      }
+      return true;
+    }
+  };
   
   template<typename Iter> inline int _parse_quadhex(input<Iter> &in) {
     int uni_ch = 0, hex;
@@ -480,6 +1121,31 @@ namespace picojson {
     return true;
   }
   
+  // parses the character(s) following a backslash
+  template<typename String, typename Iter> inline bool _parse_escape(String& out, input<Iter>& in) {
+    int ch;
+    if ((ch = in.getc()) == -1) {
+      return false;
+    }
+    switch (ch) {
+#define MAP(sym, val) case sym: out.push_back(val); break
+      MAP('"', '\"');
+      MAP('\\', '\\');
+      MAP('/', '/');
+      MAP('b', '\b');
+      MAP('f', '\f');
+      MAP('n', '\n');
+      MAP('r', '\r');
+      MAP('t', '\t');
+#undef MAP
+    case 'u':
+      return _parse_codepoint(out, in);
+    default:
+      return false;
+    }
+    return true;
+  }
+
   template<typename String, typename Iter> inline bool _parse_string(String& out, input<Iter>& in) {
     while (1) {
       int ch = in.getc();
@@ -489,26 +1155,7 @@ namespace picojson {
       } else if (ch == '"') {
 	return true;
       } else if (ch == '\\') {
-	if ((ch = in.getc()) == -1) {
-	  return false;
-	}
-	switch (ch) {
-#define MAP(sym, val) case sym: out.push_back(val); break
-	  MAP('"', '\"');
-	  MAP('\\', '\\');
-	  MAP('/', '/');
-	  MAP('b', '\b');
-	  MAP('f', '\f');
-	  MAP('n', '\n');
-	  MAP('r', '\r');
-	  MAP('t', '\t');
-#undef MAP
-	case 'u':
-	  if (! _parse_codepoint(out, in)) {
-	    return false;
-	  }
-	  break;
-	default:
+	if (! _parse_escape(out, in)) {
 	  return false;
 	}
       } else {
@@ -517,22 +1164,53 @@ namespace picojson {
     }
     return false;
   }
+
+  template<typename String> inline void _append(String& out, const char* first, const char* last) {
+    for (; first != last; ++first) {
+      out.push_back(*first);
+    }
+  }
+
+  inline void _append(std::string& out, const char* first, const char* last) {
+    out.append(first, last);
+  }
+
+  // copies runs of plain characters at once
+  template<typename String> inline bool _parse_string(String& out, input<const char*>& in) {
+    while (1) {
+      const char* run = in.cur();
+      const char* stop = _scanners<bool>::scan_string(run, in.end());
+      _append(out, run, stop);
+      in.seek(stop);
+      int ch = in.getc();
+      if (ch == '"') {
+	return true;
+      } else if (ch == '\\') {
+	if (! _parse_escape(out, in)) {
+	  return false;
+	}
+      } else {
+	in.ungetc();
+	return false;
+      }
+    }
+  }
   
   template <typename Context, typename Iter> inline bool _parse_array(Context& ctx, input<Iter>& in) {
     if (! ctx.parse_array_start()) {
       return false;
     }
+    size_t idx = 0;
     if (in.expect(']')) {
-      return true;
+      return ctx.parse_array_stop(idx);
     }
-    size_t idx = 0;
     do {
       if (! ctx.parse_array_item(in, idx)) {
 	return false;
       }
       idx++;
     } while (in.expect(','));
-    return in.expect(']');
+    return in.expect(']') && ctx.parse_array_stop(idx);
   }
   
   template <typename Context, typename Iter> inline bool _parse_object(Context& ctx, input<Iter>& in) {
@@ -540,7 +1218,7 @@ namespace picojson {
       return false;
     }
     if (in.expect('}')) {
-      return true;
+      return ctx.parse_object_stop();
     }
     do {
       std::string key;
@@ -553,24 +1231,167 @@ namespace picojson {
 	return false;
       }
     } while (in.expect(','));
-    return in.expect('}');
+    return in.expect('}') && ctx.parse_object_stop();
   }
   
-  template <typename Iter> inline bool _parse_number(double& out, input<Iter>& in) {
-    std::string num_str;
-    while (1) {
-      int ch = in.getc();
-      if (('0' <= ch && ch <= '9') || ch == '+' || ch == '-' || ch == '.'
-	  || ch == 'e' || ch == 'E') {
-	num_str.push_back(ch);
+  struct _number {
+    bool is_integer;    // no fraction nor exponent, and the magnitude fits in 64 bits
+    bool negative;
+    uint64_t magnitude; // valid if is_integer
+    double value;       // always valid
+  };
+
+  // text of a number, kept on the stack unless it is unusually long
+  class _number_text {
+    char buf_[64];
+    size_t len_;
+    std::string long_;
+  public:
+    _number_text() : len_(0) {}
+    void push_back(int ch) {
+      if (len_ < sizeof(buf_) - 1) {
+        buf_[len_++] = (char)ch;
       } else {
-	in.ungetc();
-	break;
+        if (long_.empty()) {
+          long_.assign(buf_, len_);
+        }
+        long_.push_back((char)ch);
+      }
+    }
+    double to_double() {
+      char* s;
+      if (long_.empty()) {
+        buf_[len_] = '\0';
+        s = buf_;
+      } else {
+        s = &long_[0];
+      }
+      // strtod honors the locale's decimal point
+      const char point = *localeconv()->decimal_point;
+      if (point != '.') {
+        if (char* p = strchr(s, '.')) {
+          *p = point;
+        }
+      }
+      return strtod(s, NULL);
+    }
+  };
+
+  inline double _pow10(int e) {
+    static const double table[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    return table[e];
+  }
+
+  /*
+   * parses a number following the JSON grammar. integers are accumulated
+   * exactly; other numbers are computed with a single correctly rounded
+   * operation when the mantissa and exponent are small enough (Clinger's
+   * fast path), and with strtod otherwise.
+   */
+  template <typename Iter> inline bool _parse_number(_number& out, input<Iter>& in) {
+    _number_text text;
+    uint64_t mantissa = 0;
+    int exp10 = 0;
+    bool overflow = false, integer = true;
+    int ch = in.getc();
+
+    out.negative = ch == '-';
+    if (out.negative) {
+      text.push_back(ch);
+      ch = in.getc();
+    }
+#define DIGIT(ch) ('0' <= (ch) && (ch) <= '9')
+#define ACCUMULATE(ch)                                                  \
+    if (mantissa < ~(uint64_t)0 / 10                                    \
+        || (mantissa == ~(uint64_t)0 / 10 && ch - '0' <= (int)(~(uint64_t)0 % 10))) { \
+      mantissa = mantissa * 10 + (ch - '0');                            \
+    } else {                                                            \
+      overflow = true;                                                  \
+    }
+    if (ch == '0') {
+      text.push_back(ch);
+      ch = in.getc();
+    } else if (DIGIT(ch)) {
+      do {
+        text.push_back(ch);
+        ACCUMULATE(ch)
+        ch = in.getc();
+      } while (DIGIT(ch));
+    } else {
+      in.ungetc();
+      return false;
+    }
+    if (ch == '.') {
+      integer = false;
+      text.push_back(ch);
+      ch = in.getc();
+      if (! DIGIT(ch)) {
+        in.ungetc();
+        return false;
+      }
+      do {
+        text.push_back(ch);
+        ACCUMULATE(ch)
+        if (! overflow) {
+          exp10--;
+        }
+        ch = in.getc();
+      } while (DIGIT(ch));
+    }
+    if (ch == 'e' || ch == 'E') {
+      integer = false;
+      text.push_back(ch);
+      ch = in.getc();
+      bool negative_exp = false;
+      if (ch == '+' || ch == '-') {
+        negative_exp = ch == '-';
+        text.push_back(ch);
+        ch = in.getc();
+      }
+      if (! DIGIT(ch)) {
+        in.ungetc();
+        return false;
       }
+      int e = 0;
+      do {
+        text.push_back(ch);
+        if (e < 100000) {
+          e = e * 10 + (ch - '0');
+        }
+        ch = in.getc();
+      } while (DIGIT(ch));
+      exp10 += negative_exp ? -e : e;
+    }
+#undef ACCUMULATE
+#undef DIGIT
+    in.ungetc();
+
+    out.is_integer = integer && ! overflow;
+    out.magnitude = mantissa;
+    if (out.is_integer) {
+      out.value = (double)mantissa;
+    } else if (! overflow && mantissa <= ((uint64_t)1 << 53) && -22 <= exp10 && exp10 <= 22) {
+      out.value = exp10 < 0 ? (double)mantissa / _pow10(-exp10) : (double)mantissa * _pow10(exp10);
+    } else {
+      out.value = text.to_double();
+      return true;
+    }
+    if (out.negative) {
+      out.value = -out.value;
     }
-    char* endp;
-    out = strtod(num_str.c_str(), &endp);
-    return endp == num_str.c_str() + num_str.size();
+    return true;
+  }
+
+  template <typename Iter> inline bool _parse_number(double& out, input<Iter>& in) {
+    _number num;
+    if (! _parse_number(num, in)) {
+      return false;
+    }
+    out = num.value;
+    return true;
   }
   
   template <typename Context, typename Iter> inline bool _parse(Context& ctx, input<Iter>& in) {
@@ -596,13 +1417,11 @@ namespace picojson {
     default:
       if (('0' <= ch && ch <= '9') || ch == '-') {
 	in.ungetc();
-	double f;
-	if (_parse_number(f, in)) {
-	  ctx.set_number(f);
-	  return true;
-	} else {
+	_number num;
+	if (! _parse_number(num, in)) {
 	  return false;
 	}
+	return num.is_integer ? ctx.set_integer(num.negative, num.magnitude) : ctx.set_number(num.value);
       }
       break;
     }
@@ -615,57 +1434,79 @@ namespace picojson {
     bool set_null() { return false; }
     bool set_bool(bool) { return false; }
     bool set_number(double) { return false; }
+    bool set_integer(bool, uint64_t) { return false; }
     template <typename Iter> bool parse_string(input<Iter>&) { return false; }
     bool parse_array_start() { return false; }
     template <typename Iter> bool parse_array_item(input<Iter>&, size_t) {
       return false;
     }
+    bool parse_array_stop(size_t) { return false; }
     bool parse_object_start() { return false; }
     template <typename Iter> bool parse_object_item(input<Iter>&, const std::string&) {
       return false;
     }
+    bool parse_object_stop() { return false; }
   };
   
   class default_parse_context {
   protected:
     value* out_;
+    arena* arena_;
+    void reset(int type) {
+      value(type, arena_).swap(*out_);
+    }
   public:
-    default_parse_context(value* out) : out_(out) {}
+    default_parse_context(value* out, arena* a = NULL) : out_(out), arena_(a) {}
     bool set_null() {
-      *out_ = value();
+      value().swap(*out_);
       return true;
     }
     bool set_bool(bool b) {
-      *out_ = value(b);
+      value(b).swap(*out_);
       return true;
     }
     bool set_number(double f) {
-      *out_ = value(f);
+      value(f).swap(*out_);
       return true;
     }
+    bool set_integer(bool negative, uint64_t magnitude) {
+      return set_number(negative ? -(double)magnitude : (double)magnitude);
+    }
     template<typename Iter> bool parse_string(input<Iter>& in) {
-      *out_ = value(string_type, false);
+      reset(string_type);
       return _parse_string(out_->get<std::string>(), in);
     }
     bool parse_array_start() {
-      *out_ = value(array_type, false);
+      reset(array_type);
       return true;
     }
     template <typename Iter> bool parse_array_item(input<Iter>& in, size_t) {
       array& a = out_->get<array>();
+      if (a.size() == a.capacity()) {
+        // grow by swapping, copying a value would deep copy its children
+        array grown;
+        grown.reserve(a.empty() ? 4 : a.size() * 2);
+        grown.resize(a.size());
+        for (size_t i = 0; i < a.size(); ++i) {
+          grown[i].swap(a[i]);
+        }
+        a.swap(grown);
+      }
       a.push_back(value());
-      default_parse_context ctx(&a.back());
+      default_parse_context ctx(&a.back(), arena_);
       return _parse(ctx, in);
     }
+    bool parse_array_stop(size_t) { return true; }
     bool parse_object_start() {
-      *out_ = value(object_type, false);
+      reset(object_type);
       return true;
     }
     template <typename Iter> bool parse_object_item(input<Iter>& in, const std::string& key) {
       object& o = out_->get<object>();
-      default_parse_context ctx(&o[key]);
+      default_parse_context ctx(&o[key], arena_);
       return _parse(ctx, in);
     }
+    bool parse_object_stop() { return true; }
   private:
     default_parse_context(const default_parse_context&);
     default_parse_context& operator=(const default_parse_context&);
@@ -681,6 +1522,7 @@ namespace picojson {
     bool set_null() { return true; }
     bool set_bool(bool) { return true; }
     bool set_number(double) { return true; }
+    bool set_integer(bool, uint64_t) { return true; }
     template <typename Iter> bool parse_string(input<Iter>& in) {
       dummy_str s;
       return _parse_string(s, in);
@@ -689,15 +1531,161 @@ namespace picojson {
     template <typename Iter> bool parse_array_item(input<Iter>& in, size_t) {
       return _parse(*this, in);
     }
+    bool parse_array_stop(size_t) { return true; }
     bool parse_object_start() { return true; }
     template <typename Iter> bool parse_object_item(input<Iter>& in, const std::string&) {
       return _parse(*this, in);
     }
+    bool parse_object_stop() { return true; }
   private:
     null_parse_context(const null_parse_context&);
     null_parse_context& operator=(const null_parse_context&);
   };
   
+  // validates values without decoding them, for values nobody is going to read. accepts exactly what _parse
+  // accepts, but numbers are not converted and strings are not copied. on failure p is left at the offending
+  // character, like the position _parse stops at
+  struct _null_string {
+    void push_back(int) {}
+  };
+
+  inline const char* _skip_ws_short(const char* p, const char* end) {
+    if (p != end && _is_ws(*p)) {
+      p = _scanners<bool>::skip_ws(p + 1, end);
+    }
+    return p;
+  }
+
+  inline bool _skip_string(const char*& p, const char* end) {
+    _null_string s;
+    while (1) {
+      p = _scanners<bool>::scan_string(p, end);
+      if (p == end || (*p != '"' && *p != '\\')) {
+        return false;
+      }
+      if (*p++ == '"') {
+        return true;
+      }
+      input<const char*> in(p, end);
+      const bool ok = _parse_escape(s, in);
+      p = in.cur();
+      if (! ok) {
+        return false;
+      }
+    }
+  }
+
+  inline bool _skip_number(const char*& p, const char* end) {
+#define DIGIT(p) ((p) != end && '0' <= *(p) && *(p) <= '9')
+    if (p != end && *p == '-') {
+      ++p;
+    }
+    if (p != end && *p == '0') {
+      ++p;
+    } else if (DIGIT(p)) {
+      do { ++p; } while (DIGIT(p));
+    } else {
+      return false;
+    }
+    if (p != end && *p == '.') {
+      ++p;
+      if (! DIGIT(p)) {
+        return false;
+      }
+      do { ++p; } while (DIGIT(p));
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+      ++p;
+      if (p != end && (*p == '+' || *p == '-')) {
+        ++p;
+      }
+      if (! DIGIT(p)) {
+        return false;
+      }
+      do { ++p; } while (DIGIT(p));
+    }
+#undef DIGIT
+    return true;
+  }
+
+  inline bool _skip_literal(const char*& p, const char* end, const char* text, size_t len) {
+    for (size_t i = 0; i != len; ++i, ++p) {
+      if (p == end || *p != text[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  inline bool _skip(const char*& p, const char* end) {
+    p = _skip_ws_short(p, end);
+    if (p == end) {
+      return false;
+    }
+    switch (*p) {
+    case '"':
+      ++p;
+      return _skip_string(p, end);
+    case 'n':
+      return _skip_literal(p, end, "null", 4);
+    case 't':
+      return _skip_literal(p, end, "true", 4);
+    case 'f':
+      return _skip_literal(p, end, "false", 5);
+    case '[':
+      p = _skip_ws_short(p + 1, end);
+      if (p != end && *p == ']') {
+        ++p;
+        return true;
+      }
+      while (1) {
+        if (! _skip(p, end)) {
+          return false;
+        }
+        p = _skip_ws_short(p, end);
+        if (p == end || (*p != ',' && *p != ']')) {
+          return false;
+        }
+        if (*p++ == ']') {
+          return true;
+        }
+      }
+    case '{':
+      p = _skip_ws_short(p + 1, end);
+      if (p != end && *p == '}') {
+        ++p;
+        return true;
+      }
+      while (1) {
+        if (p == end || *p != '"') {
+          return false;
+        }
+        ++p;
+        if (! _skip_string(p, end)) {
+          return false;
+        }
+        p = _skip_ws_short(p, end);
+        if (p == end || *p != ':') {
+          return false;
+        }
+        ++p;
+        if (! _skip(p, end)) {
+          return false;
+        }
+        p = _skip_ws_short(p, end);
+        if (p == end || (*p != ',' && *p != '}')) {
+          return false;
+        }
+        if (*p++ == '}') {
+          return true;
+        }
+        p = _skip_ws_short(p, end);
+      }
+    default:
+      return _skip_number(p, end);
+    }
+  }
+
   // obsolete, use the version below
   template <typename Iter> inline std::string parse(value& out, Iter& pos, const Iter& last) {
     std::string err;
@@ -705,26 +1693,44 @@ namespace picojson {
     return err;
   }
   
+  // "syntax error at line N near: " followed by the rest of the line, without control characters
+  inline std::string _syntax_error_prefix(int line) {
+    char buf[64];
+    SNPRINTF(buf, sizeof(buf), "syntax error at line %d near: ", line);
+    return buf;
+  }
+
+  template <typename Iter> inline void _syntax_error(std::string& err, input<Iter>& in) {
+    err = _syntax_error_prefix(in.line());
+    while (1) {
+      int ch = in.getc();
+      if (ch == -1 || ch == '\n') {
+	break;
+      } else if (ch >= ' ') {
+	err.push_back(ch);
+      }
+    }
+  }
+
+  inline void _syntax_error(std::string& err, int line, const char* near, const char* last) {
+    err = _syntax_error_prefix(line);
+    for (; near != last && *near != '\n'; ++near) {
+      if (static_cast<unsigned char>(*near) >= ' ') {
+	err.push_back(*near);
+      }
+    }
+  }
+
   template <typename Context, typename Iter> inline Iter _parse(Context& ctx, const Iter& first, const Iter& last, std::string* err) {
     input<Iter> in(first, last);
     if (! _parse(ctx, in) && err != NULL) {
-      char buf[64];
-      SNPRINTF(buf, sizeof(buf), "syntax error at line %d near: ", in.line());
-      *err = buf;
-      while (1) {
-	int ch = in.getc();
-	if (ch == -1 || ch == '\n') {
-	  break;
-	} else if (ch >= ' ') {
-	  err->push_back(ch);
-	}
-      }
+      _syntax_error(*err, in);
     }
     return in.cur();
   }
   
-  template <typename Iter> inline Iter parse(value& out, const Iter& first, const Iter& last, std::string* err) {
-    default_parse_context ctx(&out);
+  template <typename Iter> inline Iter parse(value& out, const Iter& first, const Iter& last, std::string* err, arena* a = NULL) {
+    default_parse_context ctx(&out, a);
     return _parse(ctx, first, last, err);
   }
   